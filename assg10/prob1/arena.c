@@ -0,0 +1,77 @@
+/*
+ * File: arena.c
+ * Author: Andy Siegel
+ * Purpose: A bump allocator for the dependency graph. Everything the graph
+ * owns is carved out of large blocks in allocation order, so related
+ * objects sit next to each other in memory and the whole graph is released
+ * with one call instead of one free() per node, edge and command.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define ARENA_ALIGN _Alignof(max_align_t)
+
+/* init_arena(Arena *arena) - sets up an empty arena */
+void init_arena(Arena *arena) {
+    arena->blocks = NULL;
+}
+
+/* arena_alloc(Arena *arena, size_t size) - returns size bytes of uninitialized memory aligned for any type */
+void *arena_alloc(Arena *arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    ArenaBlock *block = arena->blocks;
+    if (block == NULL || block->size - block->used < size) {
+        size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        block = malloc(sizeof(ArenaBlock) + block_size);
+        if (block == NULL) {
+            perror("malloc for arena block");
+            exit(1);
+        }
+        block->used = 0;
+        block->size = block_size;
+
+        // An oversized request gets a block of its own behind the current
+        // one, so the space left in the current block is not wasted
+        if (arena->blocks != NULL && block_size > ARENA_BLOCK_SIZE) {
+            block->next = arena->blocks->next;
+            arena->blocks->next = block;
+        } else {
+            block->next = arena->blocks;
+            arena->blocks = block;
+        }
+    }
+    void *result = block->data + block->used;
+    block->used += size;
+    return result;
+}
+
+/* arena_grow(Arena *arena, void *array, int count, int *capacity, size_t elem_size) - makes room for one more
+ * element in an array of count elements, doubling its capacity when it is full. Returns the array to use
+ * from now on; an outgrown array is left in the arena and freed with it. */
+void *arena_grow(Arena *arena, void *array, int count, int *capacity, size_t elem_size) {
+    if (count < *capacity) {
+        return array;
+    }
+    int new_capacity = *capacity == 0 ? 4 : *capacity * 2;
+    void *new_array = arena_alloc(arena, elem_size * new_capacity);
+    if (count > 0) {
+        memcpy(new_array, array, elem_size * count);
+    }
+    *capacity = new_capacity;
+    return new_array;
+}
+
+/* free_arena(Arena *arena) - frees every block in the arena */
+void free_arena(Arena *arena) {
+    ArenaBlock *block = arena->blocks;
+    while (block != NULL) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->blocks = NULL;
+}
@@ -0,0 +1,26 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// One block of arena memory; blocks are chained so they can all be freed at once.
+// data starts on the same boundary malloc guarantees, which the header alone would miss.
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t used;
+    size_t size;
+    _Alignas(max_align_t) char data[];
+} ArenaBlock;
+
+// Bump allocator: memory is handed out in order and only freed all together
+typedef struct Arena {
+    ArenaBlock *blocks;
+} Arena;
+
+// Function prototypes
+void init_arena(Arena *arena);
+void *arena_alloc(Arena *arena, size_t size);
+void *arena_grow(Arena *arena, void *array, int count, int *capacity, size_t elem_size);
+void free_arena(Arena *arena);
+
+#endif
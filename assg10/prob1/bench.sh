@@ -0,0 +1,46 @@
+#!/bin/bash
+
+# This script benchmarks how long mymake takes to parse large generated makefiles.
+# Each makefile has N targets where every target depends on the one before it and
+# on a few earlier targets. The goal 'bench' has no dependencies or commands, so the
+# run time is almost all parsing. Parse time should grow linearly with N.
+#
+# Usage: ./bench.sh [mymake executable] [sizes...]
+
+# --- Configuration ---
+MYMAKE_EXEC=$(realpath "${1:-./mymake2}")
+shift
+SIZES="${@:-10000 20000 40000 80000}"
+BENCH_DIR=$(mktemp -d)
+
+# --- Generate a makefile with $1 targets into $2 ---
+generate_makefile() {
+    awk -v n="$1" 'BEGIN {
+        srand(352);
+        print "bench:";
+        for (i = 1; i <= n; i++) {
+            printf "target%d.o :", i;
+            if (i > 1) printf " target%d.o", i - 1;
+            for (j = 0; j < 3 && i > 1; j++) printf " target%d.o", int(rand() * (i - 1)) + 1;
+            printf " source%d.c\n", i;
+            printf "\tgcc -Wall -c source%d.c -o target%d.o\n", i, i;
+        }
+    }' > "$2"
+}
+
+# --- Start of Script ---
+echo "Benchmarking $MYMAKE_EXEC"
+printf "%10s %12s %14s\n" "targets" "seconds" "us/target"
+
+for size in $SIZES; do
+    makefile="$BENCH_DIR/bench_$size.mk"
+    generate_makefile "$size" "$makefile"
+
+    start=$(date +%s.%N)
+    (cd "$BENCH_DIR" && "$MYMAKE_EXEC" -f "$makefile" bench >/dev/null 2>&1)
+    end=$(date +%s.%N)
+
+    awk -v n="$size" -v s="$start" -v e="$end" 'BEGIN { printf "%10d %12.3f %14.2f\n", n, e - s, (e - s) * 1000000 / n }'
+done
+
+rm -rf "$BENCH_DIR"
@@ -0,0 +1,397 @@
+/*
+ * File: builddb.c
+ * Author: Andy Siegel
+ * Purpose: Reads and writes the build database (.mymake_db). For every target
+ * it remembers the mtime, a hash of the command list and the dependencies
+ * (with their mtimes) from the last successful run, so mymake can tell when
+ * a recipe or a set of inputs changed even if the mtimes alone would not.
+ *
+ * With --hash, dependencies are compared by content instead of mtime. Each
+ * file's content hash is cached together with the inode, size and mtime it
+ * was taken at, so a file is only read again after it changes.
+ *
+ * The file is plain text, one record per target:
+ *   T <mtime in ns> <recipe hash> <number of dependencies> <name>
+ *   D <mtime in ns> <content hash> <dependency name>   (once per dependency)
+ * and one line per file with a known content hash:
+ *   F <inode> <size> <mtime in ns> <content hash> <name>
+ * and one line per target whose recipe was measured in a parallel build:
+ *   R <peak RSS in KB> <name>
+ * Names go last on the line so they may contain spaces.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "builddb.h"
+#include "hash.h"
+#include "expand.h"
+
+#define DB_MAGIC "mymake-db "
+#define DB_VERSION 3
+
+// Compare dependencies by content hash instead of by mtime (--hash)
+static int hash_mode = 0;
+
+/* set_db_hash_mode(int enabled) - turns content hash comparison on or off */
+void set_db_hash_mode(int enabled) {
+    hash_mode = enabled;
+}
+
+/* read_file_hash(const char *path, unsigned long *hash) - hashes the contents of a file, returns 0 on success
+ * and -1 if it cannot be read as a regular file */
+static int read_file_hash(const char *path, unsigned long *hash) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return -1;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        *hash = hash_contents("", 0);
+        return 0;
+    }
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return -1;
+    }
+    *hash = hash_contents(data, st.st_size);
+    munmap(data, st.st_size);
+    return 0;
+}
+
+/* content_hash(Node *node) - returns the content hash of an existing node's file, reading the file only if
+ * it changed since the cached hash was taken. Files that cannot be read (directories) hash their mtime. */
+unsigned long content_hash(Node *node) {
+    Fingerprint *fp = &node->fingerprint;
+    if (fp->valid && fp->inode == node->inode && fp->size == node->size && fp->mod_time_ns == node->mod_time_ns) {
+        return fp->hash;
+    }
+    unsigned long hash;
+    if (read_file_hash(node->name, &hash) != 0) {
+        hash = hash_bytes(&node->mod_time_ns, sizeof(node->mod_time_ns));
+    }
+    // Never hand out 0, which the database uses for "unknown"
+    if (hash == 0) {
+        hash = 1;
+    }
+    fp->inode = node->inode;
+    fp->size = node->size;
+    fp->mod_time_ns = node->mod_time_ns;
+    fp->hash = hash;
+    fp->valid = 1;
+    return hash;
+}
+
+/* known_hash(Node *node) - returns the content hash of a completed node for its record: computed in --hash
+ * mode, otherwise only if the cached one is still current, and 0 when unknown */
+static unsigned long known_hash(Node *node) {
+    if (!node->exists) {
+        return 0;
+    }
+    Fingerprint *fp = &node->fingerprint;
+    if (hash_mode || (fp->valid && fp->inode == node->inode && fp->size == node->size
+            && fp->mod_time_ns == node->mod_time_ns)) {
+        return content_hash(node);
+    }
+    return 0;
+}
+
+/* recipe_hash(Node *node) - returns a hash of the commands of node, in order */
+unsigned long recipe_hash(Node *node) {
+    expand_recipe(node);
+    unsigned long hash = HASH_INIT;
+    for (int i = 0; i < node->num_commands; i++) {
+        hash = hash_update(hash, node->commands[i], strlen(node->commands[i]) + 1);
+    }
+    return hash;
+}
+
+/* rebuild_because(Node *node, BuildReason reason, Node *dep) - records why node is out of date, returns 1 */
+static int rebuild_because(Node *node, BuildReason reason, Node *dep) {
+    node->reason = reason;
+    node->reason_dep = dep;
+    return 1;
+}
+
+/* db_must_build(Node *node, int *decided) - compares node and its completed dependencies against the
+ * database record. Sets *decided to 1 and returns whether to build when the record is usable, and
+ * sets *decided to 0 when the caller should fall back to comparing mtimes. */
+int db_must_build(Node *node, int *decided) {
+    DbRecord *record = node->db_record;
+    *decided = 0;
+    if (record == NULL || !node->is_target) {
+        return 0;
+    }
+
+    // A changed recipe always rebuilds, whatever the mtimes say
+    if (record->recipe_hash != recipe_hash(node)) {
+        *decided = 1;
+        return rebuild_because(node, REASON_RECIPE_CHANGED, NULL);
+    }
+
+    // By mtime: if the target was touched since we built it, the record no
+    // longer describes it and plain mtime comparison has to decide. By
+    // content, only the inputs matter.
+    if (!node->exists || (!hash_mode && node->mod_time_ns != record->mod_time_ns)) {
+        return 0;
+    }
+
+    *decided = 1;
+    if (record->num_dependencies != node->num_dependencies) {
+        return rebuild_because(node, REASON_DEPS_CHANGED, NULL);
+    }
+    for (int i = 0; i < node->num_dependencies; i++) {
+        Node *dep = node->dependencies[i];
+        if (record->dependencies[i] != dep) {
+            return rebuild_because(node, REASON_DEPS_CHANGED, NULL);
+        }
+        if (!dep->completed) {
+            continue;
+        }
+        if (!dep->exists) {
+            return rebuild_because(node, REASON_DEP_MISSING, dep);
+        }
+        if (hash_mode) {
+            // A dependency that was rebuilt into identical contents does
+            // not cascade into rebuilding this target
+            if (content_hash(dep) != record->dep_hashes[i]) {
+                return rebuild_because(node, REASON_DEP_CONTENT, dep);
+            }
+        } else if (dep->must_build) {
+            return rebuild_because(node, REASON_DEP_REBUILT, dep);
+        } else if (dep->mod_time_ns != record->dep_mod_times_ns[i]) {
+            return rebuild_because(node, REASON_DEP_CHANGED, dep);
+        }
+    }
+    return 0;
+}
+
+/* new_record(Arena *arena, int num_dependencies) - allocates a record with room for num_dependencies entries */
+static DbRecord *new_record(Arena *arena, int num_dependencies) {
+    DbRecord *record = arena_alloc(arena, sizeof(DbRecord));
+    record->num_dependencies = num_dependencies;
+    record->dependencies = arena_alloc(arena, sizeof(Node*) * (num_dependencies + 1));
+    record->dep_mod_times_ns = arena_alloc(arena, sizeof(long long) * (num_dependencies + 1));
+    record->dep_hashes = arena_alloc(arena, sizeof(unsigned long) * (num_dependencies + 1));
+    return record;
+}
+
+/* drop_records(NodeTable *table) - detaches every record and cached hash from the nodes of table */
+static void drop_records(NodeTable *table) {
+    for (size_t i = 0; i < table->capacity; i++) {
+        if (table->slots[i] != NULL) {
+            table->slots[i]->db_record = NULL;
+            table->slots[i]->fingerprint.valid = 0;
+        }
+    }
+}
+
+/* load_db(const char *path, NodeTable *table) - attaches the records in path to the matching targets
+ * in table. Records are allocated in the graph's arena. A missing file is an empty database. Returns 0
+ * on success and -1 if the file is damaged, in which case no records are kept. */
+int load_db(const char *path, NodeTable *table) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return 0;
+    }
+
+    char *line = NULL;
+    size_t len = 0;
+    ssize_t read;
+    int result = 0;
+    DbRecord *record = NULL;
+    int next_dep = 0;
+
+    int version = 0;
+    if (getline(&line, &len, file) == -1 || sscanf(line, DB_MAGIC "%d", &version) != 1) {
+        result = -1;
+    } else if (version != DB_VERSION) {
+        // Written by another version of mymake; start over without a warning
+        free(line);
+        fclose(file);
+        return 0;
+    }
+
+    while (result == 0 && (read = getline(&line, &len, file)) != -1) {
+        if (read > 0 && line[read - 1] == '\n') {
+            line[read - 1] = '\0';
+        }
+
+        long long mod_time_ns;
+        long long size;
+        unsigned long long inode;
+        unsigned long hash;
+        int count;
+        int name_at = 0;
+        if (sscanf(line, "T %lld %lu %d %n", &mod_time_ns, &hash, &count, &name_at) == 3 && name_at > 0 && count >= 0) {
+            if (record != NULL && next_dep != record->num_dependencies) {
+                result = -1;
+                break;
+            }
+            record = new_record(&table->arena, count);
+            record->mod_time_ns = mod_time_ns;
+            record->recipe_hash = hash;
+            next_dep = 0;
+
+            // Records of names that left the makefile are read and dropped.
+            // Names that are not targets yet may still become one through a
+            // pattern rule, so they keep their records.
+            Node *node = find_node(table, line + name_at);
+            if (node != NULL && node->db_record == NULL) {
+                node->db_record = record;
+            }
+        } else if (sscanf(line, "D %lld %lu %n", &mod_time_ns, &hash, &name_at) == 2 && name_at > 0) {
+            if (record == NULL || next_dep >= record->num_dependencies) {
+                result = -1;
+                break;
+            }
+            Node *dep = find_node(table, line + name_at);
+            if (dep == NULL && table->expander != NULL && strcmp(line + name_at, ":") != 0) {
+                // Dependencies that pattern rules add only get their nodes
+                // when the build reaches them, so make the node now
+                char *name = arena_alloc(&table->arena, strlen(line + name_at) + 1);
+                strcpy(name, line + name_at);
+                dep = create_node(table, name);
+            }
+            record->dependencies[next_dep] = dep;
+            record->dep_mod_times_ns[next_dep] = mod_time_ns;
+            record->dep_hashes[next_dep] = hash;
+            next_dep++;
+        } else if (sscanf(line, "R %lld %n", &size, &name_at) == 1 && name_at > 0 && size >= 0) {
+            Node *node = find_node(table, line + name_at);
+            if (node != NULL) {
+                node->peak_rss_kb = size;
+            }
+        } else if (sscanf(line, "F %llu %lld %lld %lu %n", &inode, &size, &mod_time_ns, &hash, &name_at) == 4
+                && name_at > 0) {
+            Node *node = find_node(table, line + name_at);
+            if (node != NULL) {
+                node->fingerprint.inode = inode;
+                node->fingerprint.size = size;
+                node->fingerprint.mod_time_ns = mod_time_ns;
+                node->fingerprint.hash = hash;
+                node->fingerprint.valid = 1;
+            }
+        } else {
+            result = -1;
+        }
+    }
+    if (record != NULL && next_dep != record->num_dependencies) {
+        result = -1;
+    }
+    if (result != 0) {
+        drop_records(table);
+    }
+
+    free(line);
+    fclose(file);
+    return result;
+}
+
+/* write_record(FILE *file, Node *node) - writes the current state of a completed target */
+static void write_record(FILE *file, Node *node) {
+    fprintf(file, "T %lld %lu %d %s\n", node->exists ? node->mod_time_ns : 0,
+            recipe_hash(node), node->num_dependencies, node->name);
+    for (int i = 0; i < node->num_dependencies; i++) {
+        Node *dep = node->dependencies[i];
+        fprintf(file, "D %lld %lu %s\n", dep->exists ? dep->mod_time_ns : 0, known_hash(dep), dep->name);
+    }
+}
+
+/* write_old_record(FILE *file, Node *node) - writes the record loaded for a target this run did not reach */
+static void write_old_record(FILE *file, Node *node) {
+    DbRecord *record = node->db_record;
+    fprintf(file, "T %lld %lu %d %s\n", record->mod_time_ns, record->recipe_hash,
+            record->num_dependencies, node->name);
+    for (int i = 0; i < record->num_dependencies; i++) {
+        // A dependency that left the graph can never match again, so write a
+        // name that cannot be a target to keep the record stale
+        fprintf(file, "D %lld %lu %s\n", record->dep_mod_times_ns[i], record->dep_hashes[i],
+                record->dependencies[i] != NULL ? record->dependencies[i]->name : ":");
+    }
+}
+
+/* save_db(const char *path, NodeTable *table) - writes a record for every target that completed this run
+ * and keeps the old records of targets it did not reach. Returns 0 on success and -1 on failure. */
+int save_db(const char *path, NodeTable *table) {
+    size_t tmp_len = strlen(path) + 5;
+    char *tmp_path = malloc(tmp_len);
+    if (tmp_path == NULL) {
+        perror("malloc for build database path");
+        exit(1);
+    }
+    snprintf(tmp_path, tmp_len, "%s.tmp", path);
+
+    FILE *file = fopen(tmp_path, "w");
+    if (file == NULL) {
+        perror(tmp_path);
+        free(tmp_path);
+        return -1;
+    }
+
+    fprintf(file, "%s%d\n", DB_MAGIC, DB_VERSION);
+    for (size_t i = 0; i < table->capacity; i++) {
+        Node *node = table->slots[i];
+        if (node == NULL) {
+            continue;
+        }
+        Fingerprint *fp = &node->fingerprint;
+        if (fp->valid) {
+            fprintf(file, "F %llu %lld %lld %lu %s\n", fp->inode, fp->size, fp->mod_time_ns, fp->hash, node->name);
+        }
+        if (node->peak_rss_kb > 0) {
+            fprintf(file, "R %ld %s\n", node->peak_rss_kb, node->name);
+        }
+        if (node->completed && node->is_target) {
+            write_record(file, node);
+        } else if (!node->completed && node->db_record != NULL) {
+            // Not reached this run; keep what we knew
+            write_old_record(file, node);
+        }
+    }
+
+    // Write to a temporary file and rename it, so an interrupted run never
+    // leaves a half written database behind
+    int result = 0;
+    if (fclose(file) != 0 || rename(tmp_path, path) != 0) {
+        perror(path);
+        remove(tmp_path);
+        result = -1;
+    }
+    free(tmp_path);
+    return result;
+}
+
+/* remember_builds(NodeTable *table) - replaces the loaded records of the targets that completed with what
+ * save_db just wrote for them, so a process that keeps building (--watch) compares against its own builds */
+void remember_builds(NodeTable *table) {
+    for (size_t i = 0; i < table->capacity; i++) {
+        Node *node = table->slots[i];
+        if (node == NULL || !node->completed || !node->is_target) {
+            continue;
+        }
+        DbRecord *record = node->db_record;
+        if (record == NULL || record->num_dependencies != node->num_dependencies) {
+            record = new_record(&table->arena, node->num_dependencies);
+            node->db_record = record;
+        }
+        record->mod_time_ns = node->exists ? node->mod_time_ns : 0;
+        record->recipe_hash = recipe_hash(node);
+        for (int j = 0; j < node->num_dependencies; j++) {
+            Node *dep = node->dependencies[j];
+            record->dependencies[j] = dep;
+            record->dep_mod_times_ns[j] = dep->exists ? dep->mod_time_ns : 0;
+            record->dep_hashes[j] = known_hash(dep);
+        }
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef BUILDDB_H
+#define BUILDDB_H
+
+#include "graph.h"
+
+// Default file name of the build database
+#define DEFAULT_DB_NAME ".mymake_db"
+
+// What a target looked like after it was last built successfully
+typedef struct DbRecord {
+    long long mod_time_ns;      // Target mtime after the build
+    unsigned long recipe_hash;  // Hash of the command list that built it
+    int num_dependencies;
+    Node **dependencies;        // NULL entries are names no longer in the graph
+    long long *dep_mod_times_ns; // Dependency mtimes the build saw
+    unsigned long *dep_hashes;  // Dependency content hashes the build saw, 0 if unknown
+} DbRecord;
+
+// Function prototypes
+void set_db_hash_mode(int enabled);
+unsigned long recipe_hash(Node *node);
+unsigned long content_hash(Node *node);
+int db_must_build(Node *node, int *decided);
+int load_db(const char *path, NodeTable *table);
+int save_db(const char *path, NodeTable *table);
+void remember_builds(NodeTable *table);
+
+#endif
@@ -0,0 +1,219 @@
+/*
+ * File: cache.c
+ * Author: Andy Siegel
+ * Purpose: A content-addressed cache of built targets (--cache=DIR) that can
+ * be shared between runs and checkouts. A target's key is a hash of its
+ * name, its commands and the contents of its dependencies, and the entry
+ * stored under the key is the file the commands produced. When a target
+ * has to be built and its key is already in the cache, the file is restored
+ * instead of running the commands. Entries are stored and restored as
+ * reflinks where the file system can share blocks, else as copies, never
+ * as hard links: a target and its entry never share an inode, so a later
+ * recipe that rewrites the target in place cannot change the entry.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+#include "cache.h"
+#include "builddb.h"
+#include "hash.h"
+
+// Bytes moved per read when a file has to be copied
+#define COPY_BUFFER_SIZE 65536
+
+static const char *cache_dir = NULL;
+static int hits = 0;
+static int misses = 0;
+static int stored = 0;
+
+/* open_cache(const char *dir) - starts using dir as the cache, creating it if needed. Returns 0 on success
+ * and -1 on failure. */
+int open_cache(const char *dir) {
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+        perror(dir);
+        return -1;
+    }
+    cache_dir = dir;
+    return 0;
+}
+
+/* cache_key(Node *node, unsigned long *key) - computes the key of node from its name, its commands and the
+ * contents of its dependencies. Returns 0 on success and -1 if node cannot be cached. */
+static int cache_key(Node *node, unsigned long *key) {
+    if (node->num_commands == 0) {
+        return -1;
+    }
+    unsigned long hash = hash_update(HASH_INIT, node->name, strlen(node->name) + 1);
+    unsigned long recipe = recipe_hash(node);
+    hash = hash_update(hash, &recipe, sizeof(recipe));
+    for (int i = 0; i < node->num_dependencies; i++) {
+        Node *dep = node->dependencies[i];
+        // A dependency without a file (a phony target) says nothing about
+        // what the commands are going to produce
+        if (!dep->exists) {
+            return -1;
+        }
+        unsigned long contents = content_hash(dep);
+        hash = hash_update(hash, dep->name, strlen(dep->name) + 1);
+        hash = hash_update(hash, &contents, sizeof(contents));
+    }
+    *key = hash;
+    return 0;
+}
+
+/* entry_path(unsigned long key, const char *suffix) - returns the malloc'd path of the entry for key plus
+ * suffix. Entries are spread over 256 subdirectories by the top byte of the key. */
+static char *entry_path(unsigned long key, const char *suffix) {
+    size_t size = strlen(cache_dir) + strlen(suffix) + 32;
+    char *path = malloc(size);
+    if (path == NULL) {
+        perror("malloc for cache path");
+        exit(1);
+    }
+    snprintf(path, size, "%s/%02lx/%016lx%s", cache_dir, key >> 56, key, suffix);
+    return path;
+}
+
+/* copy_contents(int in, int out) - copies everything from in to out, returns 0 on success and -1 on failure */
+static int copy_contents(int in, int out) {
+    char buf[COPY_BUFFER_SIZE];
+    ssize_t n;
+    while ((n = read(in, buf, sizeof(buf))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        for (ssize_t done = 0; done < n; ) {
+            ssize_t written = write(out, buf + done, n - done);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                return -1;
+            }
+            done += written;
+        }
+    }
+    return 0;
+}
+
+/* clone_file(const char *src, const char *dst) - makes the new file dst a reflink of the regular file src, or
+ * else a copy of it. Returns 0 on success and -1 on failure. */
+static int clone_file(const char *src, const char *dst) {
+    int in = open(src, O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(in, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(in);
+        return -1;
+    }
+    int out = open(dst, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, st.st_mode & 07777);
+    if (out < 0) {
+        close(in);
+        return -1;
+    }
+
+    int result = 0;
+    if (ioctl(out, FICLONE, in) != 0) {
+        result = copy_contents(in, out);
+    }
+    if (close(out) != 0) {
+        result = -1;
+    }
+    close(in);
+    if (result != 0) {
+        unlink(dst);
+    }
+    return result;
+}
+
+/* cache_restore(Node *node) - restores node from the cache instead of building it. Returns 1 if it was
+ * restored and 0 if the commands have to run. */
+int cache_restore(Node *node) {
+    unsigned long key;
+    if (cache_dir == NULL || cache_key(node, &key) != 0) {
+        return 0;
+    }
+
+    // Restore next to the target and rename it into place, so an
+    // interrupted restore never leaves a partial target behind
+    char *entry = entry_path(key, "");
+    char *tmp = malloc(strlen(node->name) + sizeof(".mymake-tmp"));
+    if (tmp == NULL) {
+        perror("malloc for cache path");
+        exit(1);
+    }
+    sprintf(tmp, "%s.mymake-tmp", node->name);
+    unlink(tmp);
+
+    int restored = 0;
+    if (clone_file(entry, tmp) == 0) {
+        if (rename(tmp, node->name) == 0) {
+            // The entry keeps the mtime it was stored with; the target has
+            // to look newer than the dependencies it was just made from
+            utimensat(AT_FDCWD, node->name, NULL, 0);
+            restored = 1;
+        } else {
+            unlink(tmp);
+        }
+    }
+    free(tmp);
+    free(entry);
+
+    if (restored) {
+        hits++;
+        printf("mymake: '%s' restored from the cache.\n", node->name);
+        fflush(stdout);
+    } else {
+        misses++;
+    }
+    return restored;
+}
+
+/* cache_store(Node *node) - adds the file node was just built into to the cache */
+void cache_store(Node *node) {
+    unsigned long key;
+    if (cache_dir == NULL || !node->exists || cache_key(node, &key) != 0) {
+        return;
+    }
+
+    char *dir = entry_path(key, "");
+    *strrchr(dir, '/') = '\0';
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+        perror(dir);
+        free(dir);
+        return;
+    }
+    free(dir);
+
+    // Write under a private name and rename, so readers only ever see
+    // complete entries even with several builds sharing the cache
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".tmp.%d", (int)getpid());
+    char *entry = entry_path(key, "");
+    char *tmp = entry_path(key, suffix);
+    if (clone_file(node->name, tmp) == 0) {
+        if (rename(tmp, entry) == 0) {
+            stored++;
+        } else {
+            unlink(tmp);
+        }
+    }
+    free(tmp);
+    free(entry);
+}
+
+/* cache_report() - prints the cache hit and miss counts if the cache was used */
+void cache_report(void) {
+    if (cache_dir != NULL) {
+        fprintf(stderr, "mymake: cache %s: %d hits, %d misses, %d stored\n", cache_dir, hits, misses, stored);
+    }
+}
@@ -0,0 +1,12 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "graph.h"
+
+// Function prototypes
+int open_cache(const char *dir);
+int cache_restore(Node *node);
+void cache_store(Node *node);
+void cache_report(void);
+
+#endif
@@ -0,0 +1,341 @@
+/*
+ * File: exec.c
+ * Author: Andy Siegel
+ * Purpose: Runs recipe commands without paying for a new /bin/sh on every
+ * line. Commands made of plain words are started directly with posix_spawn,
+ * unless the first word is something sh has as a builtin (echo, printf,
+ * test, ...), whose output can differ from the program of the same name.
+ * Anything else that needs the shell (quotes, redirection, variables) is
+ * sent to one long-lived /bin/sh coprocess, which runs each command in a
+ * subshell so cd, exit and friends cannot leak into the next command.
+ *
+ * The coprocess is not quite a new sh per line, so the status is a system()
+ * style status, and there are three differences that matter:
+ *  - $$ would be the coprocess's pid on every line, and kill $$ would kill
+ *    it, so commands containing $$ are run with system() itself.
+ *  - A command killed by a signal inside the coprocess comes back as exit
+ *    status 128+n, as sh reports it in $?, not as a signal status.
+ *  - The command is run with eval, since a syntax error anywhere else would
+ *    end the coprocess, so sh puts "eval: " in front of the errors it
+ *    prints: "sh: 1: eval: cc: not found" rather than "sh: 1: cc: not
+ *    found". Only the message differs, not the status.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "exec.h"
+
+extern char **environ;
+
+// Characters that mean a command has to go through the shell
+#define SHELL_CHARS "|&;<>()$`\\\"'*?[]#~=%{}!\n"
+
+// Shell file descriptors for the command's stdin and the status pipe
+#define SHELL_STDIN_FD 4
+#define SHELL_STATUS_FD 3
+
+// Most words a directly spawned command may have
+#define MAX_WORDS 256
+
+// Words that name shell builtins or keywords rather than programs. Builtins
+// that also exist as programs are here too: /bin/echo -e is not sh's echo -e.
+static const char *shell_words[] = {
+    "echo", "printf", "test", "true", "false", "pwd", ":", "fc",
+    "cd", "exit", "export", "unset", "set", "eval", "exec", "source", ".",
+    "alias", "unalias", "umask", "ulimit", "read", "wait", "trap", "shift",
+    "return", "break", "continue", "times", "type", "hash", "command",
+    "readonly", "local", "getopts", "jobs", "fg", "bg", "kill", "if", "then",
+    "else", "elif", "fi", "for", "while", "until", "do", "done", "case",
+    "esac", NULL
+};
+
+// The persistent shell, started the first time a command needs it
+static pid_t shell_pid = -1;
+static int shell_input = -1;    // We write commands here
+static FILE *shell_status = NULL; // The shell writes each exit status here
+
+// Per-command timing report
+static int timings_enabled = 0;
+static int is_worker = 0;
+static int spawned_count = 0;
+static int shell_count = 0;
+static double spawned_ms = 0;
+static double shell_ms = 0;
+
+/* set_exec_timings(int enabled) - turns the per-command wall time report on or off */
+void set_exec_timings(int enabled) {
+    timings_enabled = enabled;
+}
+
+/* now_ms() - returns a monotonic timestamp in milliseconds */
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/* split_words(char *buf, char **argv) - splits buf in place on blanks, returns the word count or -1 if
+ * the command must go through the shell */
+static int split_words(char *buf, char **argv) {
+    int argc = 0;
+    char *word = strtok(buf, " \t");
+    while (word != NULL) {
+        if (argc == MAX_WORDS) {
+            return -1;
+        }
+        argv[argc++] = word;
+        word = strtok(NULL, " \t");
+    }
+    argv[argc] = NULL;
+    if (argc == 0) {
+        return -1;
+    }
+    for (int i = 0; shell_words[i] != NULL; i++) {
+        if (strcmp(argv[0], shell_words[i]) == 0) {
+            return -1;
+        }
+    }
+    return argc;
+}
+
+/* spawn_command(const char *command, int *status) - runs a plain command directly. Returns 0 and sets
+ * *status to the wait status if it ran, or -1 if the shell has to handle it instead. */
+static int spawn_command(const char *command, int *status) {
+    if (strpbrk(command, SHELL_CHARS) != NULL) {
+        return -1;
+    }
+
+    char *buf = strdup(command);
+    if (buf == NULL) {
+        perror("strdup for command");
+        exit(1);
+    }
+    char *argv[MAX_WORDS + 1];
+    if (split_words(buf, argv) < 0) {
+        free(buf);
+        return -1;
+    }
+
+    posix_spawnattr_t attr;
+    sigset_t defaults;
+    posix_spawnattr_init(&attr);
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF);
+
+    // If the program cannot be started (not found, not executable) let the
+    // shell try, so the error message and exit status match system()
+    pid_t pid;
+    int err = posix_spawnp(&pid, argv[0], NULL, &attr, argv, environ);
+    posix_spawnattr_destroy(&attr);
+    free(buf);
+    if (err != 0) {
+        return -1;
+    }
+
+    while (waitpid(pid, status, 0) < 0) {
+        if (errno != EINTR) {
+            perror("waitpid");
+            *status = -1;
+            break;
+        }
+    }
+    return 0;
+}
+
+/* start_shell() - starts the persistent shell, returns 0 on success and -1 on failure */
+static int start_shell(void) {
+    int cmd_pipe[2];
+    int status_pipe[2];
+    if (pipe2(cmd_pipe, O_CLOEXEC) != 0) {
+        perror("pipe");
+        return -1;
+    }
+    if (pipe2(status_pipe, O_CLOEXEC) != 0) {
+        perror("pipe");
+        close(cmd_pipe[0]);
+        close(cmd_pipe[1]);
+        return -1;
+    }
+
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        close(cmd_pipe[0]);
+        close(cmd_pipe[1]);
+        close(status_pipe[0]);
+        close(status_pipe[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        // Keep our stdin for the commands, read the commands from the pipe.
+        // The pipe ends are moved out of the way first: if other files are
+        // already open they may sit on the descriptors the shell needs.
+        signal(SIGPIPE, SIG_DFL);
+        int cmd_fd = fcntl(cmd_pipe[0], F_DUPFD_CLOEXEC, 10);
+        int status_fd = fcntl(status_pipe[1], F_DUPFD_CLOEXEC, 10);
+        if (cmd_fd < 0 || status_fd < 0 || dup2(STDIN_FILENO, SHELL_STDIN_FD) < 0
+                || dup2(cmd_fd, STDIN_FILENO) < 0 || dup2(status_fd, SHELL_STATUS_FD) < 0) {
+            perror("dup2");
+            _exit(127);
+        }
+        execl("/bin/sh", "sh", (char*)NULL);
+        perror("/bin/sh");
+        _exit(127);
+    }
+
+    close(cmd_pipe[0]);
+    close(status_pipe[1]);
+    shell_status = fdopen(status_pipe[0], "r");
+    if (shell_status == NULL) {
+        perror("fdopen");
+        close(cmd_pipe[1]);
+        close(status_pipe[0]);
+        return -1;
+    }
+    shell_pid = pid;
+    shell_input = cmd_pipe[1];
+    return 0;
+}
+
+/* stop_shell() - closes the persistent shell's pipes and waits for it to exit */
+static void stop_shell(void) {
+    if (shell_pid > 0) {
+        close(shell_input);
+        fclose(shell_status);
+        while (waitpid(shell_pid, NULL, 0) < 0 && errno == EINTR);
+    }
+    shell_status = NULL;
+    shell_input = -1;
+    shell_pid = -1;
+}
+
+/* write_all(int fd, const char *buf, size_t len) - writes all of buf, returns 0 on success and -1 on failure */
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t written = write(fd, buf, len);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += written;
+        len -= written;
+    }
+    return 0;
+}
+
+/* shell_command(const char *command) - runs a command in the persistent shell, returns a system() style status */
+static int shell_command(const char *command) {
+    if (shell_pid < 0 && start_shell() != 0) {
+        return -1;
+    }
+
+    // Quote the command for eval: every ' becomes '\''. Running it in a
+    // subshell keeps the shell's own state clean between commands, and eval
+    // keeps a syntax error from killing the coprocess.
+    size_t len = strlen(command);
+    size_t quotes = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (command[i] == '\'') quotes++;
+    }
+    const char *suffix = "' ) <&4 4<&- 3>&-; echo $? >&3\n";
+    size_t size = len + quotes * 3 + strlen(suffix) + 16;
+    char *script = malloc(size);
+    if (script == NULL) {
+        perror("malloc for shell command");
+        exit(1);
+    }
+    char *out = script;
+    out += sprintf(out, "( eval '");
+    for (size_t i = 0; i < len; i++) {
+        if (command[i] == '\'') {
+            memcpy(out, "'\\''", 4);
+            out += 4;
+        } else {
+            *out++ = command[i];
+        }
+    }
+    strcpy(out, suffix);
+
+    int code = -1;
+    if (write_all(shell_input, script, strlen(script)) == 0 && fscanf(shell_status, "%d", &code) == 1) {
+        free(script);
+        return (code & 0xff) << 8;
+    }
+    free(script);
+
+    // The shell went away; report it and start a fresh one next time
+    fprintf(stderr, "mymake: command shell exited unexpectedly\n");
+    stop_shell();
+    return -1;
+}
+
+/* exec_command(const char *command) - runs one recipe command and returns its status the way system() does */
+int exec_command(const char *command) {
+    static int pipe_ignored = 0;
+    if (!pipe_ignored) {
+        // A dead shell should show up as a write error, not kill mymake
+        signal(SIGPIPE, SIG_IGN);
+        pipe_ignored = 1;
+    }
+
+    double start = now_ms();
+    int status;
+    int spawned = spawn_command(command, &status) == 0;
+    if (!spawned && strstr(command, "$$") != NULL) {
+        // Only a shell of its own gives the command its own $$
+        fflush(NULL);
+        status = system(command);
+    } else if (!spawned) {
+        status = shell_command(command);
+    }
+    double elapsed = now_ms() - start;
+
+    if (spawned) {
+        spawned_count++;
+        spawned_ms += elapsed;
+    } else {
+        shell_count++;
+        shell_ms += elapsed;
+    }
+    if (timings_enabled) {
+        fprintf(stderr, "mymake: [%9.3f ms %s] %s\n", elapsed, spawned ? "spawn" : "shell", command);
+    }
+    return status;
+}
+
+/* exec_reset_after_fork() - called in a forked worker so it starts its own shell instead of sharing ours */
+void exec_reset_after_fork(void) {
+    if (shell_status != NULL) {
+        fclose(shell_status);
+        close(shell_input);
+    }
+    shell_status = NULL;
+    shell_input = -1;
+    shell_pid = -1;
+    is_worker = 1;
+}
+
+/* exec_shutdown() - stops the persistent shell and prints the timing summary if it was asked for */
+void exec_shutdown(void) {
+    stop_shell();
+
+    if (timings_enabled && !is_worker && spawned_count + shell_count > 0) {
+        fprintf(stderr, "mymake: %d commands spawned directly in %.3f ms, %d through the shell in %.3f ms\n",
+                spawned_count, spawned_ms, shell_count, shell_ms);
+        spawned_count = shell_count = 0;
+        spawned_ms = shell_ms = 0;
+    }
+}
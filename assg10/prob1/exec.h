@@ -0,0 +1,10 @@
+#ifndef EXEC_H
+#define EXEC_H
+
+// Function prototypes
+void set_exec_timings(int enabled);
+int exec_command(const char *command);
+void exec_reset_after_fork(void);
+void exec_shutdown(void);
+
+#endif
@@ -0,0 +1,431 @@
+/*
+ * File: expand.c
+ * Author: Andy Siegel
+ * Purpose: Variables, automatic variables and pattern rules for makefiles
+ * read with --expand. Every command line is compiled once, when the
+ * makefile is parsed, into a program of tokens: runs of literal text that
+ * point into the makefile, and references to variables that are resolved
+ * to their table entry at compile time. A pattern rule's program is shared
+ * by every target the rule builds. Programs are only expanded into command
+ * strings for targets that actually run them, so an up-to-date tree costs
+ * no expansion at all.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "expand.h"
+#include "hash.h"
+
+/* enable_expansion(NodeTable *table) - makes the parser and scheduler of table handle variables and patterns */
+void enable_expansion(NodeTable *table) {
+    Expander *expander = arena_alloc(&table->arena, sizeof(Expander));
+    expander->arena = &table->arena;
+    expander->var_capacity = 64;
+    expander->var_count = 0;
+    expander->vars = arena_alloc(&table->arena, sizeof(Var*) * expander->var_capacity);
+    memset(expander->vars, 0, sizeof(Var*) * expander->var_capacity);
+    expander->patterns = NULL;
+    expander->num_patterns = 0;
+    expander->pattern_capacity = 0;
+    expander->buf = NULL;
+    expander->buf_len = 0;
+    expander->buf_capacity = 0;
+    table->expander = expander;
+}
+
+/* copy_string(Expander *expander, const char *str, size_t len) - returns a NUL terminated copy of len
+ * bytes of str in the arena */
+static char *copy_string(Expander *expander, const char *str, size_t len) {
+    char *copy = arena_alloc(expander->arena, len + 1);
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+/* find_var_slot(Var **vars, size_t capacity, const char *name, size_t len) - returns the slot holding the
+ * variable named by len bytes of name, or the empty slot where it belongs */
+static size_t find_var_slot(Var **vars, size_t capacity, const char *name, size_t len) {
+    size_t mask = capacity - 1;
+    size_t i = hash_bytes(name, len) & mask;
+    while (vars[i] != NULL && (strncmp(vars[i]->name, name, len) != 0 || vars[i]->name[len] != '\0')) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+/* lookup_var(Expander *expander, const char *name, size_t len) - returns the variable named by len bytes of
+ * name, adding an undefined one if it is not in the table yet */
+static Var *lookup_var(Expander *expander, const char *name, size_t len) {
+    size_t slot = find_var_slot(expander->vars, expander->var_capacity, name, len);
+    if (expander->vars[slot] != NULL) {
+        return expander->vars[slot];
+    }
+
+    if ((expander->var_count + 1) * 4 > expander->var_capacity * 3) {
+        size_t new_capacity = expander->var_capacity * 2;
+        Var **new_vars = arena_alloc(expander->arena, sizeof(Var*) * new_capacity);
+        memset(new_vars, 0, sizeof(Var*) * new_capacity);
+        for (size_t i = 0; i < expander->var_capacity; i++) {
+            Var *var = expander->vars[i];
+            if (var != NULL) {
+                new_vars[find_var_slot(new_vars, new_capacity, var->name, strlen(var->name))] = var;
+            }
+        }
+        expander->vars = new_vars;
+        expander->var_capacity = new_capacity;
+        slot = find_var_slot(new_vars, new_capacity, name, len);
+    }
+
+    Var *var = arena_alloc(expander->arena, sizeof(Var));
+    var->name = copy_string(expander, name, len);
+    var->value = NULL;
+    var->program = NULL;
+    var->expanding = 0;
+    expander->vars[slot] = var;
+    expander->var_count++;
+    return var;
+}
+
+/* define_variable(NodeTable *table, char *name, char *value) - sets a variable. The value is kept as written
+ * and expanded each time the variable is used, so it may refer to variables defined later. */
+void define_variable(NodeTable *table, char *name, char *value) {
+    Var *var = lookup_var(table->expander, name, strlen(name));
+    var->value = value;
+    var->program = NULL;
+}
+
+/* init_recipe(Recipe *recipe, Expander *expander) - sets up an empty program */
+static void init_recipe(Recipe *recipe, Expander *expander) {
+    recipe->expander = expander;
+    recipe->tokens = NULL;
+    recipe->num_tokens = 0;
+    recipe->token_capacity = 0;
+    recipe->num_commands = 0;
+}
+
+/* new_recipe(NodeTable *table) - returns a new empty program for the command lines of a rule */
+Recipe *new_recipe(NodeTable *table) {
+    Recipe *recipe = arena_alloc(&table->arena, sizeof(Recipe));
+    init_recipe(recipe, table->expander);
+    return recipe;
+}
+
+/* add_token(Recipe *recipe, TokenKind kind, const char *text, int len) - appends a token to a program */
+static Token *add_token(Recipe *recipe, TokenKind kind, const char *text, int len) {
+    recipe->tokens = arena_grow(recipe->expander->arena, recipe->tokens, recipe->num_tokens,
+            &recipe->token_capacity, sizeof(Token));
+    Token *token = &recipe->tokens[recipe->num_tokens++];
+    token->kind = kind;
+    token->text = text;
+    token->len = len;
+    token->var = NULL;
+    return token;
+}
+
+/* add_text(Recipe *recipe, const char *text, int len) - appends literal text to a program */
+static void add_text(Recipe *recipe, const char *text, int len) {
+    if (len > 0) {
+        add_token(recipe, TOKEN_TEXT, text, len);
+    }
+}
+
+/* compile_text(Recipe *recipe, const char *text) - appends the tokens of text to a program. $$ is a literal
+ * $, $@ $< $^ $* are the automatic variables, $(NAME) and ${NAME} name a variable, and so does the single
+ * character after any other $. */
+static void compile_text(Recipe *recipe, const char *text) {
+    const char *run = text;
+    const char *p = text;
+    while (*p != '\0') {
+        if (*p != '$') {
+            p++;
+            continue;
+        }
+        add_text(recipe, run, p - run);
+
+        char c = p[1];
+        if (c == '$') {
+            add_text(recipe, p, 1);
+            p += 2;
+        } else if (c == '@') {
+            add_token(recipe, TOKEN_TARGET, p, 2);
+            p += 2;
+        } else if (c == '<') {
+            add_token(recipe, TOKEN_FIRST_DEP, p, 2);
+            p += 2;
+        } else if (c == '^') {
+            add_token(recipe, TOKEN_ALL_DEPS, p, 2);
+            p += 2;
+        } else if (c == '*') {
+            add_token(recipe, TOKEN_STEM, p, 2);
+            p += 2;
+        } else if (c == '(' || c == '{') {
+            const char *end = strchr(p + 2, c == '(' ? ')' : '}');
+            if (end == NULL) {
+                // Unterminated reference: keep the rest of the line as it is
+                add_text(recipe, p, strlen(p));
+                p += strlen(p);
+            } else {
+                Token *token = add_token(recipe, TOKEN_VAR, p, end + 1 - p);
+                token->var = lookup_var(recipe->expander, p + 2, end - (p + 2));
+                p = end + 1;
+            }
+        } else if (c == '\0') {
+            add_text(recipe, p, 1);
+            p++;
+        } else {
+            Token *token = add_token(recipe, TOKEN_VAR, p, 2);
+            token->var = lookup_var(recipe->expander, p + 1, 1);
+            p += 2;
+        }
+        run = p;
+    }
+    add_text(recipe, run, p - run);
+}
+
+/* add_recipe_command(Recipe *recipe, char *command) - compiles one more command line into a program */
+void add_recipe_command(Recipe *recipe, char *command) {
+    compile_text(recipe, command);
+    add_token(recipe, TOKEN_END, NULL, 0);
+    recipe->num_commands++;
+}
+
+/* append(Expander *expander, const char *text, size_t len) - adds len bytes of text to the scratch buffer */
+static void append(Expander *expander, const char *text, size_t len) {
+    if (expander->buf_len + len + 1 > expander->buf_capacity) {
+        size_t new_capacity = expander->buf_capacity == 0 ? 256 : expander->buf_capacity;
+        while (expander->buf_len + len + 1 > new_capacity) {
+            new_capacity *= 2;
+        }
+        char *new_buf = realloc(expander->buf, new_capacity);
+        if (new_buf == NULL) {
+            perror("realloc for expansion");
+            exit(1);
+        }
+        expander->buf = new_buf;
+        expander->buf_capacity = new_capacity;
+    }
+    memcpy(expander->buf + expander->buf_len, text, len);
+    expander->buf_len += len;
+    expander->buf[expander->buf_len] = '\0';
+}
+
+static void expand_tokens(Expander *expander, Token *tokens, int count, Node *node);
+
+/* expand_var(Expander *expander, Var *var, Node *node) - appends the value of a variable, expanded for node.
+ * Variables the makefile never defines come from the environment. */
+static void expand_var(Expander *expander, Var *var, Node *node) {
+    if (var->value == NULL) {
+        const char *env = getenv(var->name);
+        if (env != NULL) {
+            append(expander, env, strlen(env));
+        }
+        return;
+    }
+    if (var->expanding) {
+        fprintf(stderr, "mymake: *** Recursive variable '%s' references itself (eventually). Stop.\n", var->name);
+        exit(1);
+    }
+    if (var->program == NULL) {
+        var->program = arena_alloc(expander->arena, sizeof(Recipe));
+        init_recipe(var->program, expander);
+        compile_text(var->program, var->value);
+    }
+    var->expanding = 1;
+    expand_tokens(expander, var->program->tokens, var->program->num_tokens, node);
+    var->expanding = 0;
+}
+
+/* expand_tokens(Expander *expander, Token *tokens, int count, Node *node) - appends the expansion of count
+ * tokens for node. Automatic variables are empty when node is NULL. */
+static void expand_tokens(Expander *expander, Token *tokens, int count, Node *node) {
+    for (int i = 0; i < count; i++) {
+        Token *token = &tokens[i];
+        switch (token->kind) {
+            case TOKEN_TEXT:
+                append(expander, token->text, token->len);
+                break;
+            case TOKEN_VAR:
+                expand_var(expander, token->var, node);
+                break;
+            case TOKEN_TARGET:
+                if (node != NULL) {
+                    append(expander, node->name, strlen(node->name));
+                }
+                break;
+            case TOKEN_FIRST_DEP:
+                if (node != NULL && node->num_dependencies > 0) {
+                    append(expander, node->dependencies[0]->name, strlen(node->dependencies[0]->name));
+                }
+                break;
+            case TOKEN_ALL_DEPS:
+                for (int j = 0; node != NULL && j < node->num_dependencies; j++) {
+                    if (j > 0) {
+                        append(expander, " ", 1);
+                    }
+                    append(expander, node->dependencies[j]->name, strlen(node->dependencies[j]->name));
+                }
+                break;
+            case TOKEN_STEM:
+                if (node != NULL && node->stem != NULL) {
+                    append(expander, node->stem, strlen(node->stem));
+                }
+                break;
+            case TOKEN_END:
+                break;
+        }
+    }
+}
+
+/* expand_line(NodeTable *table, const char *line) - returns a copy of a rule line in the arena with its
+ * variables expanded as they are defined so far */
+char *expand_line(NodeTable *table, const char *line) {
+    Expander *expander = table->expander;
+    Recipe program;
+    init_recipe(&program, expander);
+    compile_text(&program, line);
+    expander->buf_len = 0;
+    append(expander, "", 0);
+    expand_tokens(expander, program.tokens, program.num_tokens, NULL);
+    return copy_string(expander, expander->buf, expander->buf_len);
+}
+
+/* expand_recipe(Node *node) - fills in the commands of a node from its compiled program, the first time they
+ * are needed */
+void expand_recipe(Node *node) {
+    Recipe *recipe = node->recipe;
+    if (recipe == NULL || node->commands != NULL) {
+        return;
+    }
+    Expander *expander = recipe->expander;
+    node->commands = arena_alloc(expander->arena, sizeof(char*) * (recipe->num_commands + 1));
+    node->cmd_capacity = recipe->num_commands;
+
+    int command = 0;
+    int start = 0;
+    for (int i = 0; i < recipe->num_tokens; i++) {
+        if (recipe->tokens[i].kind == TOKEN_END) {
+            expander->buf_len = 0;
+            append(expander, "", 0);
+            expand_tokens(expander, recipe->tokens + start, i - start, node);
+            node->commands[command++] = copy_string(expander, expander->buf, expander->buf_len);
+            start = i + 1;
+        }
+    }
+}
+
+/* add_pattern_rule(NodeTable *table, char *target, char *deps) - adds a pattern rule for target, a name with
+ * one %, and the blank separated dependency patterns in deps, which are split in place */
+PatternRule *add_pattern_rule(NodeTable *table, char *target, char *deps) {
+    Expander *expander = table->expander;
+    PatternRule *rule = arena_alloc(expander->arena, sizeof(PatternRule));
+    rule->target = target;
+    rule->deps = NULL;
+    rule->num_deps = 0;
+    rule->dep_capacity = 0;
+    rule->recipe = NULL;
+
+    for (char *dep = strtok(deps, " \t\r"); dep != NULL; dep = strtok(NULL, " \t\r")) {
+        rule->deps = arena_grow(expander->arena, rule->deps, rule->num_deps, &rule->dep_capacity, sizeof(char*));
+        rule->deps[rule->num_deps++] = dep;
+    }
+
+    expander->patterns = arena_grow(expander->arena, expander->patterns, expander->num_patterns,
+            &expander->pattern_capacity, sizeof(PatternRule*));
+    expander->patterns[expander->num_patterns++] = rule;
+    return rule;
+}
+
+/* match_pattern(const char *pattern, const char *name, size_t *stem_len) - returns where the stem of name
+ * starts if it matches pattern, and NULL if it does not. The % matches at least one character. */
+static const char *match_pattern(const char *pattern, const char *name, size_t *stem_len) {
+    const char *percent = strchr(pattern, '%');
+    size_t prefix_len = percent - pattern;
+    size_t suffix_len = strlen(percent + 1);
+    size_t name_len = strlen(name);
+    if (name_len <= prefix_len + suffix_len || strncmp(name, pattern, prefix_len) != 0
+            || strcmp(name + name_len - suffix_len, percent + 1) != 0) {
+        return NULL;
+    }
+    *stem_len = name_len - prefix_len - suffix_len;
+    return name + prefix_len;
+}
+
+/* substitute(Expander *expander, const char *pattern, const char *stem, size_t stem_len) - builds pattern
+ * with its % replaced by the stem in the scratch buffer, and returns the buffer */
+static char *substitute(Expander *expander, const char *pattern, const char *stem, size_t stem_len) {
+    expander->buf_len = 0;
+    const char *percent = strchr(pattern, '%');
+    if (percent == NULL) {
+        append(expander, pattern, strlen(pattern));
+    } else {
+        append(expander, pattern, percent - pattern);
+        append(expander, stem, stem_len);
+        append(expander, percent + 1, strlen(percent + 1));
+    }
+    return expander->buf;
+}
+
+/* rule_applies(NodeTable *table, PatternRule *rule, const char *stem, size_t stem_len) - returns 1 if every
+ * dependency of the rule, for this stem, is a file or a target, and 0 otherwise */
+static int rule_applies(NodeTable *table, PatternRule *rule, const char *stem, size_t stem_len) {
+    for (int i = 0; i < rule->num_deps; i++) {
+        char *name = substitute(table->expander, rule->deps[i], stem, stem_len);
+        Node *dep = find_node(table, name);
+        struct stat st;
+        if ((dep == NULL || !dep->is_target) && stat(name, &st) != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* apply_pattern_rules(NodeTable *table, Node *node) - gives a node without commands the first pattern rule
+ * that matches it and whose dependencies can be had. The rule's dependencies come first, so $< is the
+ * one the pattern names. Called by the scheduler, so only nodes the build reaches are ever matched. */
+void apply_pattern_rules(NodeTable *table, Node *node) {
+    Expander *expander = table->expander;
+    if (expander == NULL || node->num_commands > 0) {
+        return;
+    }
+
+    for (int i = 0; i < expander->num_patterns; i++) {
+        PatternRule *rule = expander->patterns[i];
+        size_t stem_len;
+        const char *stem = match_pattern(rule->target, node->name, &stem_len);
+        if (rule->recipe == NULL || stem == NULL || !rule_applies(table, rule, stem, stem_len)) {
+            continue;
+        }
+
+        Node **deps = arena_alloc(expander->arena, sizeof(Node*) * (rule->num_deps + node->num_dependencies));
+        for (int j = 0; j < rule->num_deps; j++) {
+            char *name = substitute(expander, rule->deps[j], stem, stem_len);
+            Node *dep = find_node(table, name);
+            if (dep == NULL) {
+                dep = create_node(table, copy_string(expander, name, expander->buf_len));
+            }
+            deps[j] = dep;
+        }
+        if (node->num_dependencies > 0) {
+            memcpy(deps + rule->num_deps, node->dependencies, sizeof(Node*) * node->num_dependencies);
+        }
+        node->dependencies = deps;
+        node->num_dependencies += rule->num_deps;
+        node->dep_capacity = node->num_dependencies;
+
+        node->stem = copy_string(expander, stem, stem_len);
+        node->recipe = rule->recipe;
+        node->num_commands = rule->recipe->num_commands;
+        node->is_target = 1;
+        return;
+    }
+}
+
+/* free_expansion(NodeTable *table) - frees what the expander holds outside the arena */
+void free_expansion(NodeTable *table) {
+    if (table->expander != NULL) {
+        free(table->expander->buf);
+        table->expander = NULL;
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef EXPAND_H
+#define EXPAND_H
+
+#include "graph.h"
+
+// Kinds of token in a compiled command or variable value
+typedef enum TokenKind {
+    TOKEN_TEXT,         // Literal text
+    TOKEN_VAR,          // $(NAME)
+    TOKEN_TARGET,       // $@
+    TOKEN_FIRST_DEP,    // $<
+    TOKEN_ALL_DEPS,     // $^
+    TOKEN_STEM,         // $*
+    TOKEN_END           // End of one command line
+} TokenKind;
+
+struct Var;
+
+// One token of a compiled program. Text points into the makefile.
+typedef struct Token {
+    TokenKind kind;
+    const char *text;
+    int len;
+    struct Var *var;    // Resolved when the reference is compiled
+} Token;
+
+// Command lines or a variable value compiled once into tokens, and expanded
+// for each target that actually has to run them
+typedef struct Recipe {
+    struct Expander *expander;
+    Token *tokens;
+    int num_tokens;
+    int token_capacity;
+    int num_commands;
+} Recipe;
+
+// A makefile variable; its value is expanded each time it is used
+typedef struct Var {
+    char *name;
+    char *value;        // NULL until the makefile defines it
+    Recipe *program;    // The value, compiled on first use
+    int expanding;      // Set while expanding, to catch self reference
+} Var;
+
+// A rule like "%.o: %.c" whose target and dependencies contain one %
+typedef struct PatternRule {
+    char *target;
+    char **deps;
+    int num_deps;
+    int dep_capacity;
+    Recipe *recipe;
+} PatternRule;
+
+// Variables and pattern rules of a makefile read with --expand
+typedef struct Expander {
+    Arena *arena;
+    Var **vars;         // Open-addressing table, like the node table
+    size_t var_capacity;
+    size_t var_count;
+    PatternRule **patterns;
+    int num_patterns;
+    int pattern_capacity;
+    char *buf;          // Scratch space expansions are built in
+    size_t buf_len;
+    size_t buf_capacity;
+} Expander;
+
+// Function prototypes
+void enable_expansion(NodeTable *table);
+void define_variable(NodeTable *table, char *name, char *value);
+Recipe *new_recipe(NodeTable *table);
+void add_recipe_command(Recipe *recipe, char *command);
+char *expand_line(NodeTable *table, const char *line);
+PatternRule *add_pattern_rule(NodeTable *table, char *target, char *deps);
+void apply_pattern_rules(NodeTable *table, Node *node);
+void expand_recipe(Node *node);
+void free_expansion(NodeTable *table);
+
+#endif
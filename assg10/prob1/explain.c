@@ -0,0 +1,141 @@
+/*
+ * File: explain.c
+ * Author: Andy Siegel
+ * Purpose: Tells the user how much work a build is going to be. With
+ * --explain every out-of-date target is printed with the reason it has to
+ * be built. With --explain or -n a summary at the end counts the
+ * out-of-date targets and their commands, and estimates how many of them
+ * could build in parallel: the out-of-date targets divided by the longest
+ * chain of them that has to build one after another.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "explain.h"
+#include "schedule.h"
+
+static int explain = 0;
+static int stale_targets = 0;
+static int stale_commands = 0;
+static int longest_chain = 0;
+
+// How many out-of-date targets sit at each chain length. Targets with the
+// same length do not depend on each other, so this is the most that could
+// run at once at that point of the build.
+static int *level_counts = NULL;
+static int level_capacity = 0;
+
+/* set_explain(int enabled) - turns printing the reason for each rebuild on or off */
+void set_explain(int enabled) {
+    explain = enabled;
+}
+
+/* print_reason(Node *node) - prints why node is out of date */
+static void print_reason(Node *node) {
+    const char *dep = node->reason_dep != NULL ? node->reason_dep->name : "";
+    printf("mymake: '%s' is out of date: ", node->name);
+    switch (node->reason) {
+        case REASON_MISSING:
+            printf("it does not exist\n");
+            break;
+        case REASON_DEP_MISSING:
+            printf("'%s' does not exist\n", dep);
+            break;
+        case REASON_DEP_NEWER:
+            printf("'%s' is newer\n", dep);
+            break;
+        case REASON_DEP_REBUILT:
+            printf("'%s' is being rebuilt\n", dep);
+            break;
+        case REASON_DEP_CHANGED:
+            printf("'%s' changed since the last build\n", dep);
+            break;
+        case REASON_DEP_CONTENT:
+            printf("the contents of '%s' changed since the last build\n", dep);
+            break;
+        case REASON_DEPS_CHANGED:
+            printf("its dependencies changed since the last build\n");
+            break;
+        case REASON_RECIPE_CHANGED:
+            printf("its commands changed since the last build\n");
+            break;
+        case REASON_NONE:
+            printf("no reason recorded\n");
+            break;
+    }
+}
+
+/* count_level(int level) - counts one more out-of-date target at a chain length */
+static void count_level(int level) {
+    if (level >= level_capacity) {
+        int new_capacity = level_capacity == 0 ? 64 : level_capacity;
+        while (level >= new_capacity) {
+            new_capacity *= 2;
+        }
+        int *new_counts = realloc(level_counts, sizeof(int) * new_capacity);
+        if (new_counts == NULL) {
+            perror("realloc for explain levels");
+            exit(1);
+        }
+        for (int i = level_capacity; i < new_capacity; i++) {
+            new_counts[i] = 0;
+        }
+        level_counts = new_counts;
+        level_capacity = new_capacity;
+    }
+    level_counts[level]++;
+}
+
+/* explain_node(Node *node) - accounts for a node once it is decided whether it must be built. Its
+ * dependencies are all complete, so the chains ending at them are known. */
+void explain_node(Node *node) {
+    if (!explain && !dry_run_enabled()) {
+        return;
+    }
+
+    node->depth = 0;
+    for (int i = 0; i < node->num_dependencies; i++) {
+        Node *dep = node->dependencies[i];
+        if (dep->completed && waits_on(node, dep) && dep->depth > node->depth) {
+            node->depth = dep->depth;
+        }
+    }
+    if (!node->must_build) {
+        return;
+    }
+
+    node->depth++;
+    stale_targets++;
+    stale_commands += node->num_commands;
+    if (node->depth > longest_chain) {
+        longest_chain = node->depth;
+    }
+    count_level(node->depth);
+    if (explain) {
+        print_reason(node);
+    }
+}
+
+/* explain_summary() - prints how much work the build was, for --explain and -n */
+void explain_summary(void) {
+    if (!explain && !dry_run_enabled()) {
+        return;
+    }
+
+    int widest = 0;
+    for (int i = 0; i < level_capacity; i++) {
+        if (level_counts[i] > widest) {
+            widest = level_counts[i];
+        }
+    }
+    printf("mymake: %d targets out of date, %d commands to run\n", stale_targets, stale_commands);
+    if (stale_targets > 0) {
+        printf("mymake: longest chain %d, estimated parallel width %.1f (at most %d at once)\n",
+                longest_chain, (double)stale_targets / longest_chain, widest);
+    }
+    fflush(stdout);
+
+    free(level_counts);
+    level_counts = NULL;
+    level_capacity = 0;
+}
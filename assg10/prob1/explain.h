@@ -0,0 +1,11 @@
+#ifndef EXPLAIN_H
+#define EXPLAIN_H
+
+#include "graph.h"
+
+// Function prototypes
+void set_explain(int enabled);
+void explain_node(Node *node);
+void explain_summary(void);
+
+#endif
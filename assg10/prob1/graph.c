@@ -7,205 +7,306 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include "graph.h"
+#include "hash.h"
+#include "builddb.h"
+#include "cache.h"
+#include "exec.h"
+#include "expand.h"
+#include "schedule.h"
+#include "trace.h"
+#include "explain.h"
 
-/* find_node(NodeList *head, const char *name) - finds a node in the linked list by name */
-Node* find_node(NodeList *head, const char *name) {
-    NodeList *current = head;
-    while (current != NULL) {
-        if (strcmp(current->node->name, name) == 0) {
-            return current->node;
-        }
-        current = current->next;
+// Print commands instead of running them (-n)
+static int dry_run = 0;
+
+/* init_table(NodeTable *table) - sets up an empty node table */
+void init_table(NodeTable *table) {
+    init_arena(&table->node_arena);
+    init_arena(&table->arena);
+    table->capacity = 64;
+    table->count = 0;
+    table->text = NULL;
+    table->text_len = 0;
+    table->last_line = NULL;
+    table->expander = NULL;
+    table->slots = calloc(table->capacity, sizeof(Node*));
+    if (table->slots == NULL) {
+        perror("calloc for node table");
+        exit(1);
     }
-    return NULL;
 }
 
-/* create_node(const char *name) - creates a new node with the given name */
-Node* create_node(const char *name) {
-    Node *newNode = (Node*)malloc(sizeof(Node));
-    if (newNode == NULL) {
-        perror("malloc for node");
-        exit(1);
+/* find_slot(Node **slots, size_t capacity, const char *name) - returns the slot holding name, or the empty slot where it belongs */
+static size_t find_slot(Node **slots, size_t capacity, const char *name) {
+    size_t mask = capacity - 1;
+    size_t i = hash_string(name) & mask;
+    while (slots[i] != NULL && strcmp(slots[i]->name, name) != 0) {
+        i = (i + 1) & mask;
     }
-    newNode->name = strdup(name);
-    if (newNode->name == NULL) {
-        perror("strdup for node name");
+    return i;
+}
+
+/* grow_table(NodeTable *table) - doubles the table and rehashes every node into it */
+static void grow_table(NodeTable *table) {
+    size_t new_capacity = table->capacity * 2;
+    Node **new_slots = calloc(new_capacity, sizeof(Node*));
+    if (new_slots == NULL) {
+        perror("calloc for node table");
         exit(1);
     }
+    for (size_t i = 0; i < table->capacity; i++) {
+        if (table->slots[i] != NULL) {
+            new_slots[find_slot(new_slots, new_capacity, table->slots[i]->name)] = table->slots[i];
+        }
+    }
+    free(table->slots);
+    table->slots = new_slots;
+    table->capacity = new_capacity;
+}
+
+/* find_node(NodeTable *table, const char *name) - finds a node in the table by name */
+Node* find_node(NodeTable *table, const char *name) {
+    return table->slots[find_slot(table->slots, table->capacity, name)];
+}
+
+/* create_node(NodeTable *table, char *name) - creates a new node and adds it to the table. The name is not
+ * copied, so it must live as long as the table (the parser passes pointers into the mapped makefile). */
+Node* create_node(NodeTable *table, char *name) {
+    // Keep the load factor under 3/4 so probe sequences stay short
+    if ((table->count + 1) * 4 > table->capacity * 3) {
+        grow_table(table);
+    }
+
+    Node *newNode = arena_alloc(&table->node_arena, sizeof(Node));
+    newNode->name = name;
     newNode->dependencies = NULL;
     newNode->num_dependencies = 0;
+    newNode->dep_capacity = 0;
     newNode->commands = NULL;
     newNode->num_commands = 0;
+    newNode->cmd_capacity = 0;
     newNode->visited = 0;
     newNode->is_target = 0;
     newNode->completed = 0;
     newNode->mod_time = 0;
+    newNode->mod_time_ns = 0;
+    newNode->inode = 0;
+    newNode->size = 0;
+    newNode->fingerprint.valid = 0;
     newNode->exists = 0;
     newNode->must_build = 0;
+    newNode->dependents = NULL;
+    newNode->num_dependents = 0;
+    newNode->dependents_capacity = 0;
+    newNode->pending = 0;
+    newNode->order = -1;
+    newNode->db_record = NULL;
+    newNode->build_us = 0;
+    newNode->peak_rss_kb = 0;
+    newNode->path_us = 0;
+    newNode->path_next = NULL;
+    newNode->recipe = NULL;
+    newNode->stem = NULL;
+    newNode->reason = REASON_NONE;
+    newNode->reason_dep = NULL;
+    newNode->depth = 0;
+    newNode->watchers = NULL;
+    newNode->num_watchers = 0;
+    newNode->watchers_capacity = 0;
+    newNode->watched = 0;
+    newNode->dirty = 0;
+
+    table->slots[find_slot(table->slots, table->capacity, newNode->name)] = newNode;
+    table->count++;
     return newNode;
 }
 
-/* add_node_to_list(NodeList **head, Node *newNode) - adds a node to the front of the linked list */
-void add_node_to_list(NodeList **head, Node *newNode) {
-    NodeList *newElem = (NodeList*)malloc(sizeof(NodeList));
-    if (newElem == NULL) {
-        perror("malloc for node list element");
-        exit(1);
-    }
-    newElem->node = newNode;
-    newElem->next = *head;
-    *head = newElem;
+/* add_dependency(NodeTable *table, Node *target, Node *dependency) - adds a dependency to the target node in amortized O(1) */
+void add_dependency(NodeTable *table, Node *target, Node *dependency) {
+    target->dependencies = arena_grow(&table->arena, target->dependencies, target->num_dependencies,
+            &target->dep_capacity, sizeof(Node*));
+    target->dependencies[target->num_dependencies++] = dependency;
 }
 
-/* add_dependency(Node *target, Node *dependency) - adds a dependency to the target node */
-void add_dependency(Node *target, Node *dependency) {
-    DepList *new_dep = (DepList*)malloc(sizeof(DepList));
-    if (new_dep == NULL) {
-        perror("malloc for dependency list element");
-        exit(1);
-    }
-    new_dep->dependency = dependency;
-    new_dep->next = NULL;
-
-    if (target->dependencies == NULL) {
-        target->dependencies = new_dep;
-    } else {
-        DepList *current = target->dependencies;
-        while (current->next != NULL) {
-            current = current->next;
-        }
-        current->next = new_dep;
-    }
-    target->num_dependencies++;
+/* add_dependent(NodeTable *table, Node *dep, Node *node) - records the reverse edge from dep back to node */
+void add_dependent(NodeTable *table, Node *dep, Node *node) {
+    dep->dependents = arena_grow(&table->arena, dep->dependents, dep->num_dependents,
+            &dep->dependents_capacity, sizeof(Node*));
+    dep->dependents[dep->num_dependents++] = node;
 }
 
-/* add_command(Node *target, const char *command) - adds a command to the target node */
-void add_command(Node *target, const char *command) {
-    CmdList *new_cmd = (CmdList*)malloc(sizeof(CmdList));
-    if (new_cmd == NULL) {
-        perror("malloc for command list element");
-        exit(1);
-    }
-    new_cmd->command = strdup(command);
-    if (new_cmd->command == NULL) {
-        perror("strdup for command");
-        exit(1);
-    }
-    new_cmd->next = NULL;
+/* add_command(NodeTable *table, Node *target, char *command) - adds a command to the target node, without copying it */
+void add_command(NodeTable *table, Node *target, char *command) {
+    target->commands = arena_grow(&table->arena, target->commands, target->num_commands,
+            &target->cmd_capacity, sizeof(char*));
+    target->commands[target->num_commands++] = command;
+}
 
-    if (target->commands == NULL) {
-        target->commands = new_cmd;
-    } else {
-        CmdList *current = target->commands;
-        while (current->next != NULL) {
-            current = current->next;
-        }
-        current->next = new_cmd;
-    }
-    target->num_commands++;
+/* set_dry_run(int enabled) - turns dry run mode (-n) on or off */
+void set_dry_run(int enabled) {
+    dry_run = enabled;
 }
 
-/* process_node(Node *node, int *commands_executed, NodeList *all_nodes) - processes a node and its dependencies */
-void process_node(Node *node, int *commands_executed, NodeList *all_nodes) {
-    if (node->visited) {
-        return;
-    }
-    node->visited = 1;
+/* dry_run_enabled() - returns whether commands are printed instead of run */
+int dry_run_enabled(void) {
+    return dry_run;
+}
 
+/* stat_node(Node *node) - refreshes the exists/mod_time fields of a node from the file system */
+void stat_node(Node *node) {
+    long long start = trace_enabled() ? trace_now() : -1;
     struct stat st;
     if (stat(node->name, &st) == 0) {
         node->exists = 1;
         node->mod_time = st.st_mtime;
+        node->mod_time_ns = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+        node->inode = st.st_ino;
+        node->size = st.st_size;
     } else {
         node->exists = 0;
     }
+    if (start >= 0) {
+        trace_stat(start);
+    }
+}
+
+/* set_must_build(Node *node, BuildReason reason, Node *dep) - marks node for building, keeping the first reason found */
+void set_must_build(Node *node, BuildReason reason, Node *dep) {
+    if (!node->must_build) {
+        node->must_build = 1;
+        node->reason = reason;
+        node->reason_dep = dep;
+    }
+}
 
-    if (!node->exists) {
-        if (node->is_target) {
-            node->must_build = 1;
-        } else {
-            fprintf(stderr, "mymake: *** No rule to make target '%s'. Stop.\n", node->name);
-            free_graph(all_nodes);
-            exit(1);
+/* update_must_build(Node *node, Node *dep) - marks node for building if the completed dep is missing or newer */
+void update_must_build(Node *node, Node *dep) {
+    if (!node->must_build) {
+        if (!dep->exists) {
+            set_must_build(node, REASON_DEP_MISSING, dep);
+        } else if (node->exists && dep->mod_time > node->mod_time) {
+            set_must_build(node, REASON_DEP_NEWER, dep);
         }
     }
+}
 
-    DepList *dep_current = node->dependencies;
-    while (dep_current != NULL) {
-        Node *dep = dep_current->dependency;
-        process_node(dep, commands_executed, all_nodes);
-
-        if (!dep->completed) {
-            fprintf(stderr, "Circular dependency detected involving target '%s'.\n", dep->name);
-        } else {
-            if (!node->must_build) {
-                if (!dep->exists || (dep->exists && node->exists && dep->mod_time > node->mod_time)) {
-                    node->must_build = 1;
-                }
-            }
+/* decide_must_build(Node *node) - decides whether node must be built once its dependencies are processed */
+void decide_must_build(Node *node) {
+    // In a dry run nothing really gets rebuilt, so a dependency that would be
+    // is assumed to come out newer than everything that depends on it
+    for (int i = 0; dry_run && !node->must_build && i < node->num_dependencies; i++) {
+        Node *dep = node->dependencies[i];
+        if (dep->completed && dep->must_build) {
+            set_must_build(node, REASON_DEP_REBUILT, dep);
         }
-        dep_current = dep_current->next;
     }
 
-    if (node->must_build) {
-        CmdList *cmd_current = node->commands;
-        while (cmd_current != NULL) {
-            printf("%s\n", cmd_current->command);
-            fflush(stdout);
-            int status = system(cmd_current->command);
-            if (status != 0) {
-                if (WIFEXITED(status)) {
-                    fprintf(stderr, "mymake: *** [%s] Error %d\n", node->name, WEXITSTATUS(status));
-                }
-                free_graph(all_nodes);
-                exit(1);
-            }
-            if(commands_executed != NULL) *commands_executed = 1;
-            cmd_current = cmd_current->next;
+    if (!node->must_build) {
+        int decided;
+        int must_build = db_must_build(node, &decided);
+        if (decided) {
+            node->must_build = must_build;
+            return;
         }
+    }
 
-        if (stat(node->name, &st) == 0) {
-            node->exists = 1;
-            node->mod_time = st.st_mtime;
-        } else {
-            node->exists = 0;
+    for (int i = 0; i < node->num_dependencies; i++) {
+        if (node->dependencies[i]->completed) {
+            update_must_build(node, node->dependencies[i]);
         }
     }
+}
 
-    node->completed = 1;
+/* run_commands(Node *node, int *commands_executed) - runs the commands of a node in order, returns 0 on success and -1 on the first failure */
+int run_commands(Node *node, int *commands_executed) {
+    expand_recipe(node);
+    for (int i = 0; i < node->num_commands; i++) {
+        printf("%s\n", node->commands[i]);
+        fflush(stdout);
+        if (dry_run) {
+            if (commands_executed != NULL) *commands_executed = 1;
+            continue;
+        }
+        long long start = trace_now();
+        int status = exec_command(node->commands[i]);
+        trace_span(node->commands[i], "command", start, trace_now());
+        if (status != 0) {
+            if (WIFEXITED(status)) {
+                fprintf(stderr, "mymake: *** [%s] Error %d\n", node->name, WEXITSTATUS(status));
+            }
+            return -1;
+        }
+        if(commands_executed != NULL) *commands_executed = 1;
+    }
+    return 0;
 }
 
-/* free_graph(NodeList *head) - frees all allocated memory for the graph */
-void free_graph(NodeList *head) {
-    NodeList *current_node_item = head;
-    while (current_node_item != NULL) {
-        Node *node = current_node_item->node;
+/* process_node(NodeTable *table, Node *node, int *commands_executed) - builds node and its dependencies one
+ * at a time, in schedule order. Returns 0 on success and -1 as soon as something cannot be built. */
+int process_node(NodeTable *table, Node *node, int *commands_executed) {
+    Schedule schedule;
+    init_schedule(&schedule);
+    long long start = trace_now();
+    build_schedule(table, node, &schedule);
+    trace_span("schedule", "phase", start, trace_now());
 
-        // Free dependency list
-        DepList *current_dep = node->dependencies;
-        while (current_dep != NULL) {
-            DepList *temp_dep = current_dep;
-            current_dep = current_dep->next;
-            free(temp_dep);
+    int result = 0;
+    for (int i = 0; i < schedule.count && result == 0; i++) {
+        Node *current = schedule.order[i];
+        stat_node(current);
+
+        if (!current->exists) {
+            if (current->is_target) {
+                set_must_build(current, REASON_MISSING, NULL);
+            } else {
+                fprintf(stderr, "mymake: *** No rule to make target '%s'. Stop.\n", current->name);
+                result = -1;
+                break;
+            }
         }
 
-        // Free command list
-        CmdList *current_cmd = node->commands;
-        while (current_cmd != NULL) {
-            free(current_cmd->command);
-            CmdList *temp_cmd = current_cmd;
-            current_cmd = current_cmd->next;
-            free(temp_cmd);
+        decide_must_build(current);
+        explain_node(current);
+
+        long long build_start = -1;
+        if (current->must_build) {
+            build_start = trace_now();
+            if (dry_run) {
+                run_commands(current, commands_executed);
+            } else if (cache_restore(current)) {
+                if (commands_executed != NULL) *commands_executed = 1;
+                stat_node(current);
+            } else {
+                if (run_commands(current, commands_executed) != 0) {
+                    result = -1;
+                    break;
+                }
+                stat_node(current);
+                cache_store(current);
+            }
         }
 
-        free(node->name);
-        free(node);
-        
-        NodeList *temp_node_item = current_node_item;
-        current_node_item = current_node_item->next;
-        free(temp_node_item);
+        current->completed = 1;
+        trace_completed(current, build_start, trace_now());
+    }
+
+    free_schedule(&schedule);
+    return result;
+}
+
+/* free_graph(NodeTable *table) - frees all memory held by the graph: the arenas, the slots and the mapped makefile */
+void free_graph(NodeTable *table) {
+    free_expansion(table);
+    free_arena(&table->node_arena);
+    free_arena(&table->arena);
+    free(table->slots);
+
+    if (table->text != NULL) {
+        munmap(table->text, table->text_len);
     }
+    free(table->last_line);
 }
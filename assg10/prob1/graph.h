@@ -1,51 +1,106 @@
 #ifndef GRAPH_H
 #define GRAPH_H
 
+#include <stddef.h>
 #include <time.h>
+#include "arena.h"
 
-// Forward declare Node to be used in DepList
-struct Node;
+struct DbRecord;
+struct Recipe;
+struct Expander;
 
-// Linked list for dependencies
-typedef struct DepList {
-    struct Node *dependency;
-    struct DepList *next;
-} DepList;
+// Hash of a file's contents and the file identity it was taken from
+typedef struct Fingerprint {
+    unsigned long long inode;
+    long long size;
+    long long mod_time_ns;
+    unsigned long hash;
+    int valid;
+} Fingerprint;
 
-// Linked list for commands
-typedef struct CmdList {
-    char *command;
-    struct CmdList *next;
-} CmdList;
+// Why a target has to be built, for --explain
+typedef enum BuildReason {
+    REASON_NONE,
+    REASON_MISSING,         // The target does not exist
+    REASON_DEP_MISSING,     // A dependency does not exist
+    REASON_DEP_NEWER,       // A dependency is newer than the target
+    REASON_DEP_REBUILT,     // A dependency is being rebuilt
+    REASON_DEP_CHANGED,     // A dependency changed since the last build (--db, --watch)
+    REASON_DEP_CONTENT,     // A dependency's contents changed (--hash)
+    REASON_DEPS_CHANGED,    // The dependency list changed (--db)
+    REASON_RECIPE_CHANGED   // The commands changed (--db)
+} BuildReason;
 
-// Node structure representing a target or dependency
+// Node structure representing a target or dependency. Its edge and command
+// arrays live in the graph's arena and grow by doubling.
 typedef struct Node {
     char *name;
-    DepList *dependencies;
+    struct Node **dependencies;
     int num_dependencies;
-    CmdList *commands;
+    int dep_capacity;
+    char **commands;        // Point into the mapped makefile
     int num_commands;
+    int cmd_capacity;
     int visited;
     int is_target;
     int completed;
     time_t mod_time;
+    long long mod_time_ns;  // Full resolution mtime, for the build database
+    unsigned long long inode;
+    long long size;
+    Fingerprint fingerprint; // Content hash, for --hash
     int exists;
     int must_build;
+    struct Node **dependents; // Reverse edges, filled in by the job scheduler
+    int num_dependents;
+    int dependents_capacity;
+    int pending;            // Dependencies not yet completed (job scheduler)
+    int order;              // Position in the build schedule, -1 until scheduled
+    struct DbRecord *db_record; // State after the last successful build, if any
+    long long build_us;     // Time spent running the recipe (--trace)
+    long peak_rss_kb;       // Largest RSS a parallel build of the recipe reached, 0 if unknown
+    long long path_us;      // Longest chain of recipe time ending here (--trace)
+    struct Node *path_next; // Dependency that chain continues through
+    struct Recipe *recipe;  // Compiled commands, expanded on first use (--expand)
+    char *stem;             // What the % matched, for a target made by a pattern rule
+    BuildReason reason;     // Why must_build was set
+    struct Node *reason_dep; // The dependency the reason is about, if any
+    int depth;              // Out-of-date targets on the longest chain ending here
+    struct Node **watchers; // Reverse edges of the whole reached graph (--watch)
+    int num_watchers;
+    int watchers_capacity;
+    int watched;            // Set once the node's edges are in the watchers lists (--watch)
+    int dirty;              // Changed or downstream of a change, not rebuilt yet (--watch)
 } Node;
 
-// Linked list of all nodes in the graph
-typedef struct NodeList {
-    Node *node;
-    struct NodeList *next;
-} NodeList;
+// Open-addressing hash table of all nodes in the graph, keyed by name
+typedef struct NodeTable {
+    Arena node_arena;       // Node structs only, so they are contiguous
+    Arena arena;            // Edge and command arrays, database records
+    Node **slots;
+    size_t capacity;        // Always a power of two
+    size_t count;
+    char *text;             // The mapped makefile that names and commands point into
+    size_t text_len;
+    char *last_line;        // Copy of an unterminated last line, if one was needed
+    struct Expander *expander; // Variables and pattern rules, NULL unless --expand
+} NodeTable;
 
 // Function prototypes
-Node* find_node(NodeList *head, const char *name);
-Node* create_node(const char *name);
-void add_node_to_list(NodeList **head, Node *newNode);
-void add_dependency(Node *target, struct Node *dependency);
-void add_command(Node *target, const char *command);
-void process_node(Node *node, int *commands_executed, NodeList *all_nodes);
-void free_graph(NodeList *head);
+void init_table(NodeTable *table);
+Node* find_node(NodeTable *table, const char *name);
+Node* create_node(NodeTable *table, char *name);
+void add_dependency(NodeTable *table, Node *target, Node *dependency);
+void add_dependent(NodeTable *table, Node *dep, Node *node);
+void add_command(NodeTable *table, Node *target, char *command);
+void set_dry_run(int enabled);
+int dry_run_enabled(void);
+void stat_node(Node *node);
+void set_must_build(Node *node, BuildReason reason, Node *dep);
+void update_must_build(Node *node, Node *dep);
+void decide_must_build(Node *node);
+int run_commands(Node *node, int *commands_executed);
+int process_node(NodeTable *table, Node *node, int *commands_executed);
+void free_graph(NodeTable *table);
 
 #endif
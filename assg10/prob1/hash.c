@@ -0,0 +1,124 @@
+/*
+ * File: hash.c
+ * Author: Andy Siegel
+ * Purpose: Hash functions shared by the mymake modules. Names and recipes use
+ * 64-bit FNV-1a, which is short and spreads target names well. File
+ * contents use XXH64, which reads 32 bytes per round and is several times
+ * faster than FNV on anything larger than a few hundred bytes.
+ */
+
+#include <string.h>
+#include "hash.h"
+
+#define FNV_PRIME 1099511628211UL
+
+/* hash_update(unsigned long hash, const void *data, size_t len) - folds len bytes of data into a running FNV-1a hash */
+unsigned long hash_update(unsigned long hash, const void *data, size_t len) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+/* hash_bytes(const void *data, size_t len) - returns the FNV-1a hash of len bytes of data */
+unsigned long hash_bytes(const void *data, size_t len) {
+    return hash_update(HASH_INIT, data, len);
+}
+
+/* hash_string(const char *str) - returns the FNV-1a hash of a NUL terminated string */
+unsigned long hash_string(const char *str) {
+    return hash_bytes(str, strlen(str));
+}
+
+#define XXH_PRIME1 11400714785074694791ULL
+#define XXH_PRIME2 14029467366897019727ULL
+#define XXH_PRIME3 1609587929392839161ULL
+#define XXH_PRIME4 9650029242287828579ULL
+#define XXH_PRIME5 2870177450012600261ULL
+
+/* rotl64(unsigned long long x, int r) - rotates x left by r bits */
+static unsigned long long rotl64(unsigned long long x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+/* read64(const unsigned char *p) - reads a little-endian 64-bit value without alignment requirements */
+static unsigned long long read64(const unsigned char *p) {
+    unsigned long long value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+/* read32(const unsigned char *p) - reads a little-endian 32-bit value without alignment requirements */
+static unsigned int read32(const unsigned char *p) {
+    unsigned int value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+/* xxh_round(unsigned long long acc, unsigned long long input) - mixes one 8-byte lane into an accumulator */
+static unsigned long long xxh_round(unsigned long long acc, unsigned long long input) {
+    acc += input * XXH_PRIME2;
+    acc = rotl64(acc, 31);
+    return acc * XXH_PRIME1;
+}
+
+/* xxh_merge(unsigned long long acc, unsigned long long val) - folds a lane accumulator into the result */
+static unsigned long long xxh_merge(unsigned long long acc, unsigned long long val) {
+    acc ^= xxh_round(0, val);
+    return acc * XXH_PRIME1 + XXH_PRIME4;
+}
+
+/* hash_contents(const void *data, size_t len) - returns the XXH64 hash (seed 0) of len bytes of data */
+unsigned long hash_contents(const void *data, size_t len) {
+    const unsigned char *p = data;
+    const unsigned char *end = p + len;
+    unsigned long long h;
+
+    if (len >= 32) {
+        unsigned long long v1 = XXH_PRIME1 + XXH_PRIME2;
+        unsigned long long v2 = XXH_PRIME2;
+        unsigned long long v3 = 0;
+        unsigned long long v4 = -XXH_PRIME1;
+        const unsigned char *limit = end - 32;
+        do {
+            v1 = xxh_round(v1, read64(p));
+            v2 = xxh_round(v2, read64(p + 8));
+            v3 = xxh_round(v3, read64(p + 16));
+            v4 = xxh_round(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = xxh_merge(h, v1);
+        h = xxh_merge(h, v2);
+        h = xxh_merge(h, v3);
+        h = xxh_merge(h, v4);
+    } else {
+        h = XXH_PRIME5;
+    }
+    h += len;
+
+    while (p + 8 <= end) {
+        h ^= xxh_round(0, read64(p));
+        h = rotl64(h, 27) * XXH_PRIME1 + XXH_PRIME4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        h ^= (unsigned long long)read32(p) * XXH_PRIME1;
+        h = rotl64(h, 23) * XXH_PRIME2 + XXH_PRIME3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= *p * XXH_PRIME5;
+        h = rotl64(h, 11) * XXH_PRIME1;
+        p++;
+    }
+
+    h ^= h >> 33;
+    h *= XXH_PRIME2;
+    h ^= h >> 29;
+    h *= XXH_PRIME3;
+    h ^= h >> 32;
+    return h;
+}
@@ -0,0 +1,15 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+
+// Starting value for hashes built up with hash_update
+#define HASH_INIT 14695981039346656037UL
+
+// Function prototypes
+unsigned long hash_update(unsigned long hash, const void *data, size_t len);
+unsigned long hash_bytes(const void *data, size_t len);
+unsigned long hash_string(const char *str);
+unsigned long hash_contents(const void *data, size_t len);
+
+#endif
@@ -0,0 +1,280 @@
+/*
+ * File: jobs.c
+ * Author: Andy Siegel
+ * Purpose: Runs the targets of the dependency graph in parallel (-j N). The
+ * reachable part of the graph is scheduled first, then targets whose
+ * dependencies are all complete are handed to a pool of forked workers.
+ * Ready targets start in the order they became ready, except that targets
+ * known from the build database to need more memory go first, so the big
+ * ones do not end up running together at the tail of the build. Workers
+ * are reaped with wait4 to learn the peak RSS of each recipe.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "jobs.h"
+#include "exec.h"
+#include "cache.h"
+#include "schedule.h"
+#include "trace.h"
+#include "explain.h"
+#include "throttle.h"
+
+// A running worker process and the target it is building
+typedef struct Job {
+    pid_t pid;
+    Node *node;
+    long long start_us;
+} Job;
+
+// A target that is ready to start, and when it became ready
+typedef struct ReadyEntry {
+    Node *node;
+    long seq;
+} ReadyEntry;
+
+// Binary heap of ready targets: largest recorded peak RSS first, and in the
+// order they became ready among equals (so without a database it is a FIFO)
+typedef struct ReadyQueue {
+    ReadyEntry *items;
+    int count;
+    int capacity;
+    long next_seq;
+} ReadyQueue;
+
+/* runs_before(ReadyEntry *a, ReadyEntry *b) - returns whether a should start before b */
+static int runs_before(ReadyEntry *a, ReadyEntry *b) {
+    if (a->node->peak_rss_kb != b->node->peak_rss_kb) {
+        return a->node->peak_rss_kb > b->node->peak_rss_kb;
+    }
+    return a->seq < b->seq;
+}
+
+/* push_ready(ReadyQueue *queue, Node *node) - queues a node that is ready to start, growing the heap as needed */
+static void push_ready(ReadyQueue *queue, Node *node) {
+    if (queue->count == queue->capacity) {
+        int new_capacity = queue->capacity == 0 ? 16 : queue->capacity * 2;
+        ReadyEntry *new_items = realloc(queue->items, sizeof(ReadyEntry) * new_capacity);
+        if (new_items == NULL) {
+            perror("realloc for ready list");
+            exit(1);
+        }
+        queue->items = new_items;
+        queue->capacity = new_capacity;
+    }
+    int i = queue->count++;
+    ReadyEntry entry = {node, queue->next_seq++};
+    while (i > 0 && runs_before(&entry, &queue->items[(i - 1) / 2])) {
+        queue->items[i] = queue->items[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    queue->items[i] = entry;
+}
+
+/* pop_ready(ReadyQueue *queue) - removes and returns the ready node that should start next */
+static Node *pop_ready(ReadyQueue *queue) {
+    Node *node = queue->items[0].node;
+    ReadyEntry last = queue->items[--queue->count];
+    int i = 0;
+    while (1) {
+        int child = 2 * i + 1;
+        if (child >= queue->count) {
+            break;
+        }
+        if (child + 1 < queue->count && runs_before(&queue->items[child + 1], &queue->items[child])) {
+            child++;
+        }
+        if (!runs_before(&queue->items[child], &last)) {
+            break;
+        }
+        queue->items[i] = queue->items[child];
+        i = child;
+    }
+    queue->items[i] = last;
+    return node;
+}
+
+/* prepare_schedule(NodeTable *table, Schedule *schedule, ReadyQueue *ready) - stats every scheduled node, counts
+ * the dependencies each one waits on and queues the ones with none. Returns -1 if a file has no rule to make it. */
+static int prepare_schedule(NodeTable *table, Schedule *schedule, ReadyQueue *ready) {
+    for (int i = 0; i < schedule->count; i++) {
+        Node *node = schedule->order[i];
+        stat_node(node);
+        if (!node->exists) {
+            if (node->is_target) {
+                set_must_build(node, REASON_MISSING, NULL);
+            } else {
+                fprintf(stderr, "mymake: *** No rule to make target '%s'. Stop.\n", node->name);
+                return -1;
+            }
+        }
+
+        node->pending = 0;
+        for (int j = 0; j < node->num_dependencies; j++) {
+            Node *dep = node->dependencies[j];
+            if (waits_on(node, dep) && !dep->completed) {
+                add_dependent(table, dep, node);
+                node->pending++;
+            }
+        }
+        if (node->pending == 0) {
+            push_ready(ready, node);
+        }
+    }
+    return 0;
+}
+
+/* release_dependents(Node *node, ReadyQueue *ready) - marks node complete and queues dependents that have nothing left to wait on */
+static void release_dependents(Node *node, ReadyQueue *ready) {
+    node->completed = 1;
+    for (int i = 0; i < node->num_dependents; i++) {
+        Node *waiting = node->dependents[i];
+        waiting->pending--;
+        if (waiting->pending == 0) {
+            push_ready(ready, waiting);
+        }
+    }
+}
+
+/* start_job(Node *node) - forks a worker that runs the commands of node in order, returns the worker pid */
+static pid_t start_job(Node *node) {
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        exec_reset_after_fork();
+        int result = run_commands(node, NULL);
+        exec_shutdown();
+        _exit(result == 0 ? 0 : 1);
+    }
+    return pid;
+}
+
+/* run_jobs(NodeTable *table, Node *goal, int max_jobs, int *commands_executed) - builds goal with up to max_jobs recipes running at once, returns 0 on success and -1 on the first failure */
+int run_jobs(NodeTable *table, Node *goal, int max_jobs, int *commands_executed) {
+    Schedule schedule;
+    ReadyQueue ready = {NULL, 0, 0, 0};
+    int result = 0;
+
+    init_schedule(&schedule);
+    long long start = trace_now();
+    build_schedule(table, goal, &schedule);
+    trace_span("schedule", "phase", start, trace_now());
+    start = trace_now();
+    if (prepare_schedule(table, &schedule, &ready) != 0) {
+        free_schedule(&schedule);
+        free(ready.items);
+        return -1;
+    }
+    trace_span("stat", "phase", start, trace_now());
+
+    Job *jobs = calloc(max_jobs, sizeof(Job));
+    if (jobs == NULL) {
+        perror("calloc for job table");
+        exit(1);
+    }
+
+    int running = 0;
+    int failed = 0;
+    Node *held = NULL;  // Needs a job, but the load or memory limit said wait
+    while (1) {
+        // Start as many ready targets as the pool and the limits allow
+        while (!failed && running < max_jobs && (held != NULL || ready.count > 0)) {
+            Node *node = held;
+            if (node == NULL) {
+                node = pop_ready(&ready);
+                decide_must_build(node);
+                explain_node(node);
+
+                if (!node->must_build || node->num_commands == 0 || cache_restore(node)) {
+                    if (node->must_build) {
+                        if (node->num_commands > 0 && commands_executed != NULL) *commands_executed = 1;
+                        stat_node(node);
+                    }
+                    trace_completed(node, -1, 0);
+                    release_dependents(node, &ready);
+                    continue;
+                }
+            }
+
+            // Retried each time a job finishes; with nothing running it always starts
+            if (!may_start_job(node, running)) {
+                held = node;
+                break;
+            }
+            held = NULL;
+
+            long long start_us = trace_now();
+            pid_t pid = start_job(node);
+            if (pid < 0) {
+                failed = 1;
+                break;
+            }
+            job_started(node);
+            for (int i = 0; i < max_jobs; i++) {
+                if (jobs[i].node == NULL) {
+                    jobs[i].pid = pid;
+                    jobs[i].node = node;
+                    jobs[i].start_us = start_us;
+                    break;
+                }
+            }
+            running++;
+        }
+
+        if (running == 0) {
+            break;
+        }
+
+        int status;
+        struct rusage usage;
+        pid_t pid = wait4(-1, &status, 0, &usage);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            perror("wait4");
+            failed = 1;
+            break;
+        }
+
+        for (int i = 0; i < max_jobs; i++) {
+            if (jobs[i].node != NULL && jobs[i].pid == pid) {
+                Node *node = jobs[i].node;
+                jobs[i].node = NULL;
+                running--;
+                if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+                    // The worker waited for its shell and commands, so its
+                    // peak covers the largest of them (Linux reports KB)
+                    node->peak_rss_kb = usage.ru_maxrss;
+                    if (commands_executed != NULL) *commands_executed = 1;
+                    stat_node(node);
+                    cache_store(node);
+                    trace_completed(node, jobs[i].start_us, trace_now());
+                    release_dependents(node, &ready);
+                } else {
+                    if (!failed && running > 0) {
+                        fprintf(stderr, "mymake: *** Waiting for unfinished jobs....\n");
+                    }
+                    failed = 1;
+                }
+                break;
+            }
+        }
+    }
+
+    if (failed) {
+        result = -1;
+    }
+    free(jobs);
+    free_schedule(&schedule);
+    free(ready.items);
+    return result;
+}
@@ -0,0 +1,9 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include "graph.h"
+
+// Function prototypes
+int run_jobs(NodeTable *table, Node *goal, int max_jobs, int *commands_executed);
+
+#endif
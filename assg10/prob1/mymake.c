@@ -7,25 +7,166 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "graph.h"
+#include "jobs.h"
+#include "builddb.h"
+#include "exec.h"
+#include "parser.h"
+#include "trace.h"
+#include "cache.h"
+#include "expand.h"
+#include "explain.h"
+#include "watch.h"
+#include "throttle.h"
 
-/* trim_whitespace(char *str) - helper to clean out whitespace from str */
-char *trim_whitespace(char *str) {
+// Job count when -l or --max-mem is given without -j: the limits decide
+#define UNLIMITED_JOBS 4096
+
+/* parse_jobs(const char *str) - converts the argument of -j to a job count, returns -1 if it is not a positive number */
+int parse_jobs(const char *str) {
     char *end;
-    while (isspace((unsigned char)*str)) str++;
-    if (*str == 0) return str;
-    end = str + strlen(str) - 1;
-    while (end > str && isspace((unsigned char)*end)) end--;
-    end[1] = '\0';
-    return str;
+    long jobs = strtol(str, &end, 10);
+    if (*str == '\0' || *end != '\0' || jobs < 1 || jobs > 4096) {
+        return -1;
+    }
+    return (int)jobs;
+}
+
+/* parse_load(const char *str) - converts the argument of -l to a load average, returns -1 if it is not a positive number */
+double parse_load(const char *str) {
+    char *end;
+    double load = strtod(str, &end);
+    if (*str == '\0' || *end != '\0' || !(load > 0)) {
+        return -1;
+    }
+    return load;
+}
+
+/* parse_size(const char *str) - converts a byte count with an optional K, M or G suffix (powers of 1024),
+ * returns -1 if it is not a positive size */
+long long parse_size(const char *str) {
+    char *end;
+    long long size = strtoll(str, &end, 10);
+    int shift = 0;
+    if (*end == 'K' || *end == 'k') {
+        shift = 10;
+    } else if (*end == 'M' || *end == 'm') {
+        shift = 20;
+    } else if (*end == 'G' || *end == 'g') {
+        shift = 30;
+    }
+    if (shift > 0) {
+        end++;
+    }
+    if (*str == '\0' || *end != '\0' || size < 1 || size > (1LL << (62 - shift))) {
+        return -1;
+    }
+    return size << shift;
+}
+
+/* build_goal(NodeTable *table, Node *goal, int max_jobs) - builds one goal on the shared graph, so work done
+ * for an earlier goal is not repeated. Returns 0 on success and -1 on failure. */
+int build_goal(NodeTable *table, Node *goal, int max_jobs) {
+    int commands_executed = 0;
+    int result;
+    if (max_jobs > 1) {
+        result = run_jobs(table, goal, max_jobs, &commands_executed);
+    } else {
+        result = process_node(table, goal, &commands_executed);
+    }
+    if (result != 0) {
+        return -1;
+    }
+    if (!commands_executed) {
+        printf("mymake: '%s' is up to date.\n", goal->name);
+    }
+    // A driver script on the other end of a pipe wants each result as it happens
+    fflush(stdout);
+    return 0;
+}
+
+/* build_stdin_goals(NodeTable *table, int max_jobs) - reads goal names from stdin, separated by blanks or
+ * newlines, and builds each one as it arrives. Returns 0 at end of input and -1 on the first failure. */
+int build_stdin_goals(NodeTable *table, int max_jobs) {
+    // Read the goals from a private copy of stdin and give recipes /dev/null,
+    // so a recipe that reads its input cannot swallow the goals that follow
+    int goals_fd = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 0);
+    FILE *goals = goals_fd < 0 ? NULL : fdopen(goals_fd, "r");
+    int null_fd = open("/dev/null", O_RDONLY);
+    if (goals == NULL || null_fd < 0 || dup2(null_fd, STDIN_FILENO) < 0) {
+        perror("stdin");
+        exit(1);
+    }
+    close(null_fd);
+
+    char *line = NULL;
+    size_t len = 0;
+    int result = 0;
+    while (result == 0 && getline(&line, &len, goals) != -1) {
+        for (char *name = strtok(line, " \t\r\n"); name != NULL && result == 0; name = strtok(NULL, " \t\r\n")) {
+            Node *goal = find_node(table, name);
+            if (goal == NULL) {
+                fprintf(stderr, "Target '%s' not found in makefile.\n", name);
+                result = -1;
+            } else {
+                result = build_goal(table, goal, max_jobs);
+            }
+        }
+    }
+    free(line);
+    fclose(goals);
+    return result;
+}
+
+/* watch_goals(NodeTable *table, Node **goals, int num_goals, int max_jobs, const char *db_name) - rebuilds
+ * the goals each time a file they depend on changes, until interrupted. Returns -1 once files can no longer
+ * be watched. */
+int watch_goals(NodeTable *table, Node **goals, int num_goals, int max_jobs, const char *db_name) {
+    if (watch_open() != 0) {
+        return -1;
+    }
+    while (1) {
+        watch_graph(table);
+        if (wait_for_changes(table) < 0) {
+            break;
+        }
+        // Goals nothing changed under are still complete and stay visited
+        int result = 0;
+        for (int i = 0; i < num_goals && result == 0; i++) {
+            if (!goals[i]->visited) {
+                result = build_goal(table, goals[i], max_jobs);
+            }
+        }
+        if (result == 0 && db_name != NULL) {
+            save_db(db_name, table);
+            remember_builds(table);
+        }
+    }
+    watch_close();
+    return -1;
 }
 
 int main(int argc, char *argv[]) {
     char *makefile_name = "myMakefile";
-    char *target_name = NULL;
+    char **goal_names = malloc(sizeof(char*) * argc);
+    int num_goals = 0;
+    int stdin_goals = 0;
     int f_flag_found = 0;
+    int max_jobs = 1;
+    int jobs_given = 0;
+    char *db_name = NULL;
+    char *trace_name = NULL;
+    char *cache_name = NULL;
+    int hash_mode = 0;
+    int expand_mode = 0;
+    int watch_mode = 0;
 
+    if (goal_names == NULL) {
+        perror("malloc for goals");
+        exit(1);
+    }
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-f") == 0) {
             if (f_flag_found) {
@@ -39,118 +180,194 @@ int main(int argc, char *argv[]) {
             }
             makefile_name = argv[i];
             f_flag_found = 1;
-        } else {
-            if (target_name != NULL) {
-                fprintf(stderr, "Error: More than one target is specified.\n");
+        } else if (strcmp(argv[i], "--timings") == 0) {
+            set_exec_timings(1);
+        } else if (strcmp(argv[i], "-n") == 0) {
+            set_dry_run(1);
+        } else if (strcmp(argv[i], "--explain") == 0) {
+            set_explain(1);
+        } else if (strcmp(argv[i], "--expand") == 0) {
+            expand_mode = 1;
+        } else if (strcmp(argv[i], "--watch") == 0) {
+            watch_mode = 1;
+        } else if (strcmp(argv[i], "--stdin-goals") == 0) {
+            stdin_goals = 1;
+        } else if (strcmp(argv[i], "--hash") == 0) {
+            hash_mode = 1;
+        } else if (strcmp(argv[i], "--db") == 0) {
+            db_name = DEFAULT_DB_NAME;
+        } else if (strncmp(argv[i], "--db=", 5) == 0) {
+            db_name = argv[i] + 5;
+            if (*db_name == '\0') {
+                fprintf(stderr, "Error: --db= needs a file name.\n");
                 exit(1);
             }
-            target_name = argv[i];
-        }
-    }
-
-    FILE *file = fopen(makefile_name, "r");
-    if (file == NULL) {
-        perror(makefile_name);
-        exit(1);
-    }
-
-    NodeList *all_nodes = NULL;
-    Node *last_target = NULL;
-    Node *first_target = NULL;
-
-    char *line = NULL;
-    size_t len = 0;
-    ssize_t read;
-
-    while ((read = getline(&line, &len, file)) != -1) {
-        if (read > 0 && line[read - 1] == '\n') {
-            line[read - 1] = '\0';
-        }
-
-        if (strlen(line) == 0 || line[0] == '#') continue;
-
-        if (line[0] == '\t') {
-            if (last_target == NULL) {
-                fprintf(stderr, "%s: illegal format: command without target on line\n", makefile_name);
-                free(line);
-                fclose(file);
-                free_graph(all_nodes);
+        } else if (strncmp(argv[i], "--trace=", 8) == 0) {
+            trace_name = argv[i] + 8;
+            if (*trace_name == '\0') {
+                fprintf(stderr, "Error: --trace= needs a file name.\n");
                 exit(1);
             }
-            add_command(last_target, line + 1);
-        } else {
-            char *colon = strchr(line, ':');
-            if (colon == NULL) continue; 
-
-            *colon = '\0';
-            char *target_str = trim_whitespace(line);
-            char *deps_str = colon + 1;
-
-            if (strlen(target_str) == 0) continue;
-            
-            Node *target_node = find_node(all_nodes, target_str);
-            if (target_node == NULL) {
-                target_node = create_node(target_str);
-                add_node_to_list(&all_nodes, target_node);
-            } else {
-                if (target_node->is_target) {
-                    fprintf(stderr, "%s: illegal format: duplicate target '%s'\n", makefile_name, target_str);
-                    free(line);
-                    fclose(file);
-                    free_graph(all_nodes);
+        } else if (strncmp(argv[i], "--cache=", 8) == 0) {
+            cache_name = argv[i] + 8;
+            if (*cache_name == '\0') {
+                fprintf(stderr, "Error: --cache= needs a directory name.\n");
+                exit(1);
+            }
+        } else if (strncmp(argv[i], "-j", 2) == 0) {
+            const char *count = argv[i] + 2;
+            if (*count == '\0') {
+                i++;
+                if (i >= argc) {
+                    fprintf(stderr, "Error: A job count does not follow a -j argument.\n");
                     exit(1);
                 }
+                count = argv[i];
             }
-            
-            if (first_target == NULL) {
-                first_target = target_node;
+            max_jobs = parse_jobs(count);
+            if (max_jobs < 0) {
+                fprintf(stderr, "Error: Invalid job count '%s'.\n", count);
+                exit(1);
             }
-            target_node->is_target = 1;
-            last_target = target_node;
-
-            char *dep_token = deps_str;
-            int offset = 0;
-            char token[256];
-
-            while (sscanf(dep_token + offset, "%255s%n", token, &offset) == 1) {
-                Node *dep_node = find_node(all_nodes, token);
-                if (dep_node == NULL) {
-                    dep_node = create_node(token);
-                    add_node_to_list(&all_nodes, dep_node);
-                }
-                add_dependency(target_node, dep_node);
-                
-                // Skip whitespace
-                while (*(dep_token + offset) && isspace((unsigned char)*(dep_token + offset))) {
-                    offset++;
+            jobs_given = 1;
+        } else if (strncmp(argv[i], "-l", 2) == 0) {
+            const char *load = argv[i] + 2;
+            if (*load == '\0') {
+                i++;
+                if (i >= argc) {
+                    fprintf(stderr, "Error: A load average does not follow a -l argument.\n");
+                    exit(1);
                 }
+                load = argv[i];
             }
-
+            double max_load = parse_load(load);
+            if (max_load < 0) {
+                fprintf(stderr, "Error: Invalid load average '%s'.\n", load);
+                exit(1);
+            }
+            set_max_load(max_load);
+        } else if (strncmp(argv[i], "--max-mem=", 10) == 0) {
+            long long max_mem = parse_size(argv[i] + 10);
+            if (max_mem < 0) {
+                fprintf(stderr, "Error: Invalid memory size '%s'.\n", argv[i] + 10);
+                exit(1);
+            }
+            set_max_mem(max_mem);
+        } else {
+            goal_names[num_goals++] = argv[i];
         }
     }
-    free(line);
-    fclose(file);
-
-    Node *final_target = NULL;
-    if (target_name != NULL) {
-        final_target = find_node(all_nodes, target_name);
-        if (final_target == NULL) {
-            fprintf(stderr, "Target '%s' not found in makefile.\n", target_name);
-            free_graph(all_nodes);
+
+    if (throttle_enabled() && !jobs_given) {
+        max_jobs = UNLIMITED_JOBS;
+    }
+    // A dry run prints the commands in the order a serial build runs them
+    if (dry_run_enabled()) {
+        max_jobs = 1;
+    }
+    // Watching needs a fixed set of goals that really get built
+    if (watch_mode && (stdin_goals || dry_run_enabled())) {
+        fprintf(stderr, "Error: --watch cannot be combined with %s.\n", stdin_goals ? "--stdin-goals" : "-n");
+        exit(1);
+    }
+
+    if (trace_name != NULL && trace_open(trace_name) != 0) {
+        exit(1);
+    }
+
+    NodeTable all_nodes;
+    init_table(&all_nodes);
+    if (expand_mode) {
+        enable_expansion(&all_nodes);
+    }
+    Node *first_target = NULL;
+    long long start = trace_now();
+    if (parse_makefile(makefile_name, &all_nodes, &first_target) != 0) {
+        trace_close(0);
+        free(goal_names);
+        free_graph(&all_nodes);
+        exit(1);
+    }
+    trace_span("parse", "phase", start, trace_now());
+
+    // Look every goal up before building any of them. With no goals at all
+    // the first target is built, unless the goals come from stdin.
+    Node **goals = malloc(sizeof(Node*) * (num_goals + 1));
+    if (goals == NULL) {
+        perror("malloc for goals");
+        exit(1);
+    }
+    for (int i = 0; i < num_goals; i++) {
+        goals[i] = find_node(&all_nodes, goal_names[i]);
+        if (goals[i] == NULL) {
+            fprintf(stderr, "Target '%s' not found in makefile.\n", goal_names[i]);
+            trace_close(0);
+            free(goals);
+            free(goal_names);
+            free_graph(&all_nodes);
             exit(1);
         }
-    } else {
-        final_target = first_target;
+    }
+    if (num_goals == 0 && !stdin_goals && first_target != NULL) {
+        goals[num_goals++] = first_target;
     }
 
-    int commands_executed = 0;
-    if (final_target != NULL) {
-        process_node(final_target, &commands_executed, all_nodes);
-        if (!commands_executed) {
-            printf("mymake: '%s' is up to date.\n", final_target->name);
+    // Content hashes are remembered in the build database, so --hash needs one
+    if (hash_mode) {
+        set_db_hash_mode(1);
+        if (db_name == NULL) {
+            db_name = DEFAULT_DB_NAME;
         }
     }
+    start = trace_now();
+    if (db_name != NULL && load_db(db_name, &all_nodes) != 0) {
+        fprintf(stderr, "mymake: warning: ignoring damaged build database '%s'.\n", db_name);
+    }
+    if (db_name != NULL) {
+        trace_span("load db", "phase", start, trace_now());
+    }
+
+    int result = 0;
+    if (cache_name != NULL && open_cache(cache_name) != 0) {
+        result = -1;
+    }
+    for (int i = 0; i < num_goals && result == 0; i++) {
+        result = build_goal(&all_nodes, goals[i], max_jobs);
+    }
+    if (result == 0 && stdin_goals) {
+        result = build_stdin_goals(&all_nodes, max_jobs);
+    }
+    cache_report();
+    if (result == 0) {
+        explain_summary();
+    }
+    // A failed build is retried once something changes, so only a failure
+    // to watch ends --watch
+    if (watch_mode) {
+        if (result == 0 && db_name != NULL) {
+            save_db(db_name, &all_nodes);
+            remember_builds(&all_nodes);
+        }
+        result = watch_goals(&all_nodes, goals, num_goals, max_jobs, db_name);
+    }
+    free(goals);
+    free(goal_names);
+    if (result != 0) {
+        exec_shutdown();
+        trace_close(0);
+        free_graph(&all_nodes);
+        exit(1);
+    }
+
+    exec_shutdown();
+    // A dry run built nothing, so there is nothing new to record
+    if (db_name != NULL && !dry_run_enabled()) {
+        start = trace_now();
+        save_db(db_name, &all_nodes);
+        trace_span("save db", "phase", start, trace_now());
+    }
+    trace_close(1);
 
-    free_graph(all_nodes);
+    free_graph(&all_nodes);
     return 0;
 }
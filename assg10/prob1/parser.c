@@ -0,0 +1,224 @@
+/*
+ * File: parser.c
+ * Author: Andy Siegel
+ * Purpose: Reads a makefile into the dependency graph. The file is mapped
+ * into memory copy-on-write and split in place: line ends and token ends
+ * are overwritten with NULs, and the nodes and commands point straight into
+ * the mapping. Nothing is copied and there is no limit on token length.
+ * With --expand, variable definitions and pattern rules are recognized as
+ * well, and command lines are compiled into token programs (expand.c).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "parser.h"
+#include "expand.h"
+
+/* trim_whitespace(char *str) - helper to clean out whitespace from str */
+static char *trim_whitespace(char *str) {
+    char *end;
+    while (isspace((unsigned char)*str)) str++;
+    if (*str == 0) return str;
+    end = str + strlen(str) - 1;
+    while (end > str && isspace((unsigned char)*end)) end--;
+    end[1] = '\0';
+    return str;
+}
+
+/* map_makefile(const char *makefile_name, NodeTable *table) - maps the makefile into memory and hands the
+ * mapping to table, which unmaps it in free_graph. Returns 0 on success and -1 on failure. */
+static int map_makefile(const char *makefile_name, NodeTable *table) {
+    int fd = open(makefile_name, O_RDONLY);
+    if (fd < 0) {
+        perror(makefile_name);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        perror(makefile_name);
+        close(fd);
+        return -1;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    char *text = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (text == MAP_FAILED) {
+        perror(makefile_name);
+        return -1;
+    }
+    table->text = text;
+    table->text_len = st.st_size;
+
+    // The last line needs a byte after it to hold its NUL. The rest of the
+    // final page reads as zeros, but if the file fills that page exactly,
+    // keep a copy of the unterminated line instead.
+    if (text[st.st_size - 1] != '\n' && st.st_size % sysconf(_SC_PAGESIZE) == 0) {
+        char *start = text + st.st_size;
+        while (start > text && start[-1] != '\n') start--;
+        size_t len = text + st.st_size - start;
+        table->last_line = malloc(len + 1);
+        if (table->last_line == NULL) {
+            perror("malloc for last makefile line");
+            exit(1);
+        }
+        memcpy(table->last_line, start, len);
+        table->last_line[len] = '\0';
+    }
+    return 0;
+}
+
+/* parse_rule(char *line, const char *makefile_name, NodeTable *table, Node **target) - adds the target
+ * line to the graph and sets *target to its node. Lines without a target are ignored and leave *target
+ * alone. Returns 0 on success and -1 if the target is defined twice. */
+static int parse_rule(char *line, const char *makefile_name, NodeTable *table, Node **target) {
+    char *colon = strchr(line, ':');
+    if (colon == NULL) return 0;
+
+    *colon = '\0';
+    char *target_str = trim_whitespace(line);
+    char *deps_str = colon + 1;
+
+    if (strlen(target_str) == 0) return 0;
+
+    Node *target_node = find_node(table, target_str);
+    if (target_node == NULL) {
+        target_node = create_node(table, target_str);
+    } else if (target_node->is_target) {
+        fprintf(stderr, "%s: illegal format: duplicate target '%s'\n", makefile_name, target_str);
+        return -1;
+    }
+    target_node->is_target = 1;
+    *target = target_node;
+
+    // Cut the dependency list into NUL terminated tokens in place
+    char *token = deps_str;
+    while (1) {
+        while (isspace((unsigned char)*token)) token++;
+        if (*token == '\0') break;
+        char *token_end = token;
+        while (*token_end != '\0' && !isspace((unsigned char)*token_end)) token_end++;
+        int last = (*token_end == '\0');
+        *token_end = '\0';
+
+        Node *dep_node = find_node(table, token);
+        if (dep_node == NULL) {
+            dep_node = create_node(table, token);
+        }
+        add_dependency(table, target_node, dep_node);
+
+        if (last) break;
+        token = token_end + 1;
+    }
+    return 0;
+}
+
+/* parse_expanded_line(char *line, const char *makefile_name, NodeTable *table, Node **target,
+ * PatternRule **pattern) - handles a line that is not a command when --expand is on: a variable definition,
+ * a pattern rule (which sets *pattern) or an ordinary rule (which sets *target and clears *pattern).
+ * Returns 0 on success and -1 if the line is badly formed. */
+static int parse_expanded_line(char *line, const char *makefile_name, NodeTable *table, Node **target,
+        PatternRule **pattern) {
+    char *equals = strchr(line, '=');
+    char *colon = strchr(line, ':');
+    if (equals != NULL && (colon == NULL || colon > equals)) {
+        *equals = '\0';
+        char *name = trim_whitespace(line);
+        if (*name != '\0') {
+            define_variable(table, name, trim_whitespace(equals + 1));
+        }
+        return 0;
+    }
+
+    // Rule lines are expanded right away, with the variables defined so far
+    if (strchr(line, '$') != NULL) {
+        line = expand_line(table, line);
+        colon = strchr(line, ':');
+    }
+    if (colon == NULL) {
+        return 0;
+    }
+
+    *colon = '\0';
+    if (strchr(line, '%') != NULL) {
+        *pattern = add_pattern_rule(table, trim_whitespace(line), colon + 1);
+        return 0;
+    }
+    *colon = ':';
+    *pattern = NULL;
+    return parse_rule(line, makefile_name, table, target);
+}
+
+/* parse_makefile(const char *makefile_name, NodeTable *table, Node **first_target) - builds the graph for a
+ * makefile and sets *first_target to its first target (NULL if there is none). Returns 0 on success and -1
+ * if the file cannot be read or is badly formed. */
+int parse_makefile(const char *makefile_name, NodeTable *table, Node **first_target) {
+    *first_target = NULL;
+    if (map_makefile(makefile_name, table) != 0) {
+        return -1;
+    }
+
+    Node *last_target = NULL;
+    PatternRule *last_pattern = NULL;
+    char *text_end = table->text + table->text_len;
+    char *line = table->text;
+    while (line < text_end) {
+        char *newline = memchr(line, '\n', text_end - line);
+        char *next = newline != NULL ? newline + 1 : text_end;
+        if (newline != NULL) {
+            *newline = '\0';
+        } else if (table->last_line != NULL) {
+            line = table->last_line;
+        }
+
+        if (line[0] == '\0' || line[0] == '#') {
+            line = next;
+            continue;
+        }
+
+        if (line[0] == '\t') {
+            if (last_target == NULL && last_pattern == NULL) {
+                fprintf(stderr, "%s: illegal format: command without target on line\n", makefile_name);
+                return -1;
+            }
+            if (table->expander == NULL) {
+                add_command(table, last_target, line + 1);
+            } else {
+                // Compiled once; a pattern rule's program is shared by all its targets
+                Recipe **recipe = last_pattern != NULL ? &last_pattern->recipe : &last_target->recipe;
+                if (*recipe == NULL) {
+                    *recipe = new_recipe(table);
+                }
+                add_recipe_command(*recipe, line + 1);
+                if (last_pattern == NULL) {
+                    last_target->num_commands = (*recipe)->num_commands;
+                }
+            }
+        } else if (table->expander != NULL) {
+            if (parse_expanded_line(line, makefile_name, table, &last_target, &last_pattern) != 0) {
+                return -1;
+            }
+            if (*first_target == NULL && last_pattern == NULL) {
+                *first_target = last_target;
+            }
+        } else {
+            if (parse_rule(line, makefile_name, table, &last_target) != 0) {
+                return -1;
+            }
+            if (*first_target == NULL) {
+                *first_target = last_target;
+            }
+        }
+        line = next;
+    }
+    return 0;
+}
@@ -0,0 +1,9 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include "graph.h"
+
+// Function prototypes
+int parse_makefile(const char *makefile_name, NodeTable *table, Node **first_target);
+
+#endif
@@ -102,6 +102,34 @@ for testfile in $TEST_FILES; do
     done
 done
 
+# --- Watch test ---
+# exMymake has no --watch, so this checks the result instead of comparing. A file edited
+# in the same second as the build that read it keeps an mtime that does not look newer,
+# and --watch has to rebuild from it anyway.
+echo "--------------------------------------------------"
+echo "Processing --watch with an edit in the same second"
+echo "--------------------------------------------------"
+watch_dir=$(mktemp -d)
+watch_exec=$(realpath "$MYMAKE_EXEC")
+printf 'all: b.c\n\tcat b.c > all\n' > "$watch_dir/myMakefile"
+echo one > "$watch_dir/b.c"
+# Start just after a second begins, so the build and the edit share it
+while [ "$(date +%N | cut -c1)" != "0" ]; do sleep 0.01; done
+(cd "$watch_dir" && exec "$watch_exec" --watch all > watch_out.txt 2>&1) &
+watch_pid=$!
+sleep 0.3
+echo two > "$watch_dir/b.c"
+sleep 0.5
+kill "$watch_pid" 2>/dev/null
+wait "$watch_pid" 2>/dev/null
+if [ "$(cat "$watch_dir/all" 2>/dev/null)" = "two" ]; then
+    echo -e "\033[32m    [PASS] --watch rebuilt 'all' after the edit.\033[0m"
+else
+    echo -e "\033[31m    [FAIL] --watch did not rebuild 'all' after the edit.\033[0m"
+    cat "$watch_dir/watch_out.txt"
+fi
+rm -rf "$watch_dir"
+
 echo "--------------------------------------------------"
 echo "Test script finished."
 if [ -f "$VALgrind_LOG" ]; then
@@ -0,0 +1,128 @@
+/*
+ * File: schedule.c
+ * Author: Andy Siegel
+ * Purpose: Topologically sorts the part of the dependency graph reachable
+ * from a goal. The depth-first search keeps its own stack instead of
+ * recursing, so very deep dependency chains cannot overflow the C stack,
+ * and it runs in O(V+E). The result is the same post-order the recursive
+ * process_node used to walk, and both the serial and the parallel
+ * executors run from it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "schedule.h"
+#include "expand.h"
+
+// One node on the search stack and the next dependency to look at
+typedef struct Frame {
+    Node *node;
+    int next_dep;
+} Frame;
+
+/* init_schedule(Schedule *schedule) - sets up an empty schedule */
+void init_schedule(Schedule *schedule) {
+    schedule->order = NULL;
+    schedule->count = 0;
+    schedule->capacity = 0;
+}
+
+/* append_scheduled(Schedule *schedule, Node *node) - gives node the next position in the schedule */
+static void append_scheduled(Schedule *schedule, Node *node) {
+    if (schedule->count == schedule->capacity) {
+        int new_capacity = schedule->capacity == 0 ? 64 : schedule->capacity * 2;
+        Node **new_order = realloc(schedule->order, sizeof(Node*) * new_capacity);
+        if (new_order == NULL) {
+            perror("realloc for schedule");
+            exit(1);
+        }
+        schedule->order = new_order;
+        schedule->capacity = new_capacity;
+    }
+    node->order = schedule->count;
+    schedule->order[schedule->count++] = node;
+}
+
+/* report_cycle(Frame *stack, int top, Node *dep) - prints the cycle closed by an edge from the top of the stack back to dep */
+static void report_cycle(Frame *stack, int top, Node *dep) {
+    int start = top;
+    while (start > 0 && stack[start].node != dep) {
+        start--;
+    }
+    fprintf(stderr, "mymake: Circular dependency dropped:");
+    for (int i = start; i <= top; i++) {
+        fprintf(stderr, " %s ->", stack[i].node->name);
+    }
+    fprintf(stderr, " %s\n", dep->name);
+}
+
+/* build_schedule(NodeTable *table, Node *goal, Schedule *schedule) - appends every unvisited node reachable
+ * from goal to the schedule, dependencies first. Nodes already visited by an earlier call are skipped.
+ * Pattern rules are matched as nodes are first reached, before their dependencies are walked. */
+void build_schedule(NodeTable *table, Node *goal, Schedule *schedule) {
+    if (goal->visited) {
+        return;
+    }
+
+    int capacity = 64;
+    int top = 0;
+    Frame *stack = malloc(sizeof(Frame) * capacity);
+    if (stack == NULL) {
+        perror("malloc for schedule stack");
+        exit(1);
+    }
+
+    goal->visited = 1;
+    apply_pattern_rules(table, goal);
+    stack[0].node = goal;
+    stack[0].next_dep = 0;
+
+    while (top >= 0) {
+        Frame *frame = &stack[top];
+        if (frame->next_dep == frame->node->num_dependencies) {
+            // Every dependency is scheduled, so the node itself can go
+            append_scheduled(schedule, frame->node);
+            top--;
+            continue;
+        }
+
+        Node *dep = frame->node->dependencies[frame->next_dep++];
+
+        if (dep->visited) {
+            // Visited but not scheduled yet means it is still on the stack
+            if (dep->order < 0) {
+                report_cycle(stack, top, dep);
+            }
+            continue;
+        }
+
+        dep->visited = 1;
+        apply_pattern_rules(table, dep);
+        if (top + 1 == capacity) {
+            capacity *= 2;
+            Frame *new_stack = realloc(stack, sizeof(Frame) * capacity);
+            if (new_stack == NULL) {
+                perror("realloc for schedule stack");
+                exit(1);
+            }
+            stack = new_stack;
+        }
+        top++;
+        stack[top].node = dep;
+        stack[top].next_dep = 0;
+    }
+
+    free(stack);
+}
+
+/* waits_on(Node *node, Node *dep) - returns 1 if the scheduled edge from node to dep must finish first,
+ * 0 if it is an edge the schedule dropped to break a cycle */
+int waits_on(Node *node, Node *dep) {
+    return dep->order >= 0 && dep->order < node->order;
+}
+
+/* free_schedule(Schedule *schedule) - frees the memory held by a schedule */
+void free_schedule(Schedule *schedule) {
+    free(schedule->order);
+    init_schedule(schedule);
+}
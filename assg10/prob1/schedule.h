@@ -0,0 +1,20 @@
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include "graph.h"
+
+// Nodes reachable from a goal, ordered so every node comes after the
+// dependencies it waits on. Edges that would close a cycle are dropped.
+typedef struct Schedule {
+    Node **order;
+    int count;
+    int capacity;
+} Schedule;
+
+// Function prototypes
+void init_schedule(Schedule *schedule);
+void build_schedule(NodeTable *table, Node *goal, Schedule *schedule);
+int waits_on(Node *node, Node *dep);
+void free_schedule(Schedule *schedule);
+
+#endif
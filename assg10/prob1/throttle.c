@@ -0,0 +1,117 @@
+/*
+ * File: throttle.c
+ * Author: Andy Siegel
+ * Purpose: Holds back new recipes while the machine is busy, for shared
+ * build hosts. With -l a recipe only starts while the load average is below
+ * the limit, and with --max-mem only while the memory in use on the host
+ * (MemTotal - MemAvailable), plus the peak RSS the recipe reached the last
+ * time it was built, stays under the limit. Both figures come from /proc and
+ * only catch up with new processes after a while, so the recipes started
+ * in the last second are added to them. A build with nothing running always
+ * starts the next recipe, so a busy host slows the build down but never
+ * stalls it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "throttle.h"
+#include "trace.h"
+
+// How long a started recipe counts on top of what /proc says
+#define RECENT_US 1000000LL
+
+static double max_load = 0;         // 0 means no limit
+static long long max_mem = 0;       // Bytes, 0 means no limit
+static long long recent_start_us = 0;
+static int recent_jobs = 0;
+static long long recent_rss = 0;    // Bytes the recent recipes are expected to need
+
+/* set_max_load(double load) - only start recipes while the load average is below load (-l) */
+void set_max_load(double load) {
+    max_load = load;
+}
+
+/* set_max_mem(long long bytes) - only start recipes while the memory in use stays below bytes (--max-mem) */
+void set_max_mem(long long bytes) {
+    max_mem = bytes;
+}
+
+/* throttle_enabled() - returns whether a load or memory limit was set */
+int throttle_enabled(void) {
+    return max_load > 0 || max_mem > 0;
+}
+
+/* read_load(double *load) - reads the one minute load average, returns 0 on success and -1 on failure */
+static int read_load(double *load) {
+    FILE *file = fopen("/proc/loadavg", "re");
+    if (file == NULL) {
+        return -1;
+    }
+    int result = fscanf(file, "%lf", load) == 1 ? 0 : -1;
+    fclose(file);
+    return result;
+}
+
+/* read_mem_used(long long *used) - reads how many bytes of memory are in use, returns 0 on success and -1
+ * on failure */
+static int read_mem_used(long long *used) {
+    FILE *file = fopen("/proc/meminfo", "re");
+    if (file == NULL) {
+        return -1;
+    }
+    long long total = -1;
+    long long available = -1;
+    char line[256];
+    while (fgets(line, sizeof(line), file) != NULL && (total < 0 || available < 0)) {
+        sscanf(line, "MemTotal: %lld kB", &total);
+        sscanf(line, "MemAvailable: %lld kB", &available);
+    }
+    fclose(file);
+    if (total < 0 || available < 0) {
+        return -1;
+    }
+    *used = (total - available) * 1024;
+    return 0;
+}
+
+/* forget_old_starts() - stops counting recipes /proc has had time to notice */
+static void forget_old_starts(void) {
+    if (trace_now() - recent_start_us > RECENT_US) {
+        recent_jobs = 0;
+        recent_rss = 0;
+    }
+}
+
+/* may_start_job(Node *node, int running) - returns whether the recipe of node may start now, with running
+ * recipes already going. If /proc cannot be read the limit it is for is ignored. */
+int may_start_job(Node *node, int running) {
+    if (running == 0 || !throttle_enabled()) {
+        return 1;
+    }
+    forget_old_starts();
+
+    double load;
+    if (max_load > 0 && read_load(&load) == 0 && load + recent_jobs >= max_load) {
+        return 0;
+    }
+    long long used;
+    if (max_mem > 0 && read_mem_used(&used) == 0
+            && used + recent_rss + node->peak_rss_kb * 1024 > max_mem) {
+        return 0;
+    }
+    return 1;
+}
+
+/* job_started(Node *node) - counts a recipe that just started until /proc catches up with it */
+void job_started(Node *node) {
+    if (!throttle_enabled()) {
+        return;
+    }
+    forget_old_starts();
+    if (recent_jobs == 0) {
+        recent_start_us = trace_now();
+    }
+    recent_jobs++;
+    recent_rss += node->peak_rss_kb * 1024;
+}
@@ -0,0 +1,13 @@
+#ifndef THROTTLE_H
+#define THROTTLE_H
+
+#include "graph.h"
+
+// Function prototypes
+void set_max_load(double load);
+void set_max_mem(long long bytes);
+int throttle_enabled(void);
+int may_start_job(Node *node, int running);
+void job_started(Node *node);
+
+#endif
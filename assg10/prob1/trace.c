@@ -0,0 +1,206 @@
+/*
+ * File: trace.c
+ * Author: Andy Siegel
+ * Purpose: Records where a build spends its time (--trace=FILE). Parsing,
+ * scheduling, stat calls, every target and every command become events in
+ * Chrome's trace-event format, which chrome://tracing and Perfetto can show
+ * as a timeline. The file is opened with O_APPEND and each event is written
+ * with a single write(), so parallel workers add their own command events
+ * to it directly. When the build is done the critical path through the
+ * dependency graph is printed: the chain of recipes that bounds the build's
+ * wall time however many jobs are used.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include "trace.h"
+#include "schedule.h"
+
+// Most critical path targets listed in the summary
+#define MAX_PATH_LINES 10
+
+static int trace_fd = -1;
+static int trace_pid;           // The main process; workers show up as its threads
+static long long trace_start;   // trace_now() counts from here
+static int stat_count = 0;
+static long long stat_us = 0;
+static int built_count = 0;
+static long long built_us = 0;
+static Node *critical_end = NULL; // Node where the longest chain of recipe time ends
+
+/* monotonic_us() - returns a monotonic timestamp in microseconds */
+static long long monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/* write_all(const char *buf, size_t len) - writes buf to the trace file in one call where possible */
+static void write_all(const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t written = write(trace_fd, buf, len);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            perror("write to trace file");
+            return;
+        }
+        buf += written;
+        len -= written;
+    }
+}
+
+/* escape_json(char *out, const char *str) - copies str into out as the inside of a JSON string, returns
+ * the number of characters written. out needs room for 6 characters per character of str. */
+static int escape_json(char *out, const char *str) {
+    int len = 0;
+    for (const unsigned char *p = (const unsigned char*)str; *p != '\0'; p++) {
+        if (*p == '"' || *p == '\\') {
+            out[len++] = '\\';
+            out[len++] = *p;
+        } else if (*p < 0x20) {
+            len += sprintf(out + len, "\\u%04x", *p);
+        } else {
+            out[len++] = *p;
+        }
+    }
+    return len;
+}
+
+/* trace_open(const char *path) - starts a trace file at path, returns 0 on success and -1 on failure */
+int trace_open(const char *path) {
+    // Close-on-exec keeps the file out of recipes but not out of forked workers
+    trace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (trace_fd < 0) {
+        perror(path);
+        return -1;
+    }
+    trace_pid = getpid();
+    trace_start = monotonic_us();
+    write_all("[\n", 2);
+    return 0;
+}
+
+/* trace_enabled() - returns whether a trace is being recorded */
+int trace_enabled(void) {
+    return trace_fd >= 0;
+}
+
+/* trace_now() - returns the time since the trace started in microseconds */
+long long trace_now(void) {
+    return monotonic_us() - trace_start;
+}
+
+/* trace_span(const char *name, const char *category, long long start_us, long long end_us) - records that
+ * name ran from start_us to end_us, in the lane of the calling process */
+void trace_span(const char *name, const char *category, long long start_us, long long end_us) {
+    if (trace_fd < 0) {
+        return;
+    }
+    size_t size = strlen(name) * 6 + 256;
+    char *buf = malloc(size);
+    if (buf == NULL) {
+        perror("malloc for trace event");
+        exit(1);
+    }
+    int len = sprintf(buf, "{\"name\":\"");
+    len += escape_json(buf + len, name);
+    len += snprintf(buf + len, size - len,
+            "\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":%d,\"tid\":%d},\n",
+            category, start_us, end_us - start_us, trace_pid, (int)getpid());
+    write_all(buf, len);
+    free(buf);
+}
+
+/* trace_stat(long long start_us) - counts one stat call that began at start_us */
+void trace_stat(long long start_us) {
+    stat_count++;
+    stat_us += trace_now() - start_us;
+}
+
+/* trace_completed(Node *node, long long start_us, long long end_us) - records a completed node, built from
+ * start_us to end_us or not built at all if start_us is negative, and extends the critical path to it */
+void trace_completed(Node *node, long long start_us, long long end_us) {
+    if (trace_fd < 0) {
+        return;
+    }
+    if (start_us >= 0) {
+        trace_span(node->name, "target", start_us, end_us);
+        node->build_us = end_us - start_us;
+        built_count++;
+        built_us += node->build_us;
+    }
+
+    // The longest chain of recipe time ending here goes through the
+    // dependency with the longest chain of its own
+    node->path_us = 0;
+    node->path_next = NULL;
+    for (int i = 0; i < node->num_dependencies; i++) {
+        Node *dep = node->dependencies[i];
+        if (dep->completed && waits_on(node, dep) && dep->path_us > node->path_us) {
+            node->path_us = dep->path_us;
+            node->path_next = dep;
+        }
+    }
+    node->path_us += node->build_us;
+    if (critical_end == NULL || node->path_us > critical_end->path_us) {
+        critical_end = node;
+    }
+}
+
+/* print_critical_path(Node *end, long long wall_us) - prints the chain of recipes ending at end, which bounded the build */
+static void print_critical_path(Node *end, long long wall_us) {
+    fprintf(stderr, "mymake: %d stat calls in %.3f ms\n", stat_count, stat_us / 1000.0);
+    if (built_count == 0) {
+        return;
+    }
+    fprintf(stderr, "mymake: critical path %.3f s of %.3f s wall, %d recipes took %.3f s (%.1fx parallelism available)\n",
+            end->path_us / 1e6, wall_us / 1e6, built_count, built_us / 1e6,
+            end->path_us > 0 ? (double)built_us / end->path_us : 1.0);
+
+    // The chain is linked from the end down; list it in build order
+    int length = 0;
+    for (Node *node = end; node != NULL; node = node->path_next) {
+        if (node->build_us > 0) length++;
+    }
+    Node **path = malloc(sizeof(Node*) * (length + 1));
+    if (path == NULL) {
+        perror("malloc for critical path");
+        exit(1);
+    }
+    int i = length;
+    for (Node *node = end; node != NULL; node = node->path_next) {
+        if (node->build_us > 0) path[--i] = node;
+    }
+    for (i = 0; i < length && i < MAX_PATH_LINES; i++) {
+        fprintf(stderr, "mymake:   %9.3f s  %s\n", path[i]->build_us / 1e6, path[i]->name);
+    }
+    if (length > MAX_PATH_LINES) {
+        fprintf(stderr, "mymake:   ... %d more\n", length - MAX_PATH_LINES);
+    }
+    free(path);
+}
+
+/* trace_close(int succeeded) - finishes the trace file and prints the critical path if the build succeeded */
+void trace_close(int succeeded) {
+    if (trace_fd < 0) {
+        return;
+    }
+    long long wall_us = trace_now();
+
+    // Every event ends in a comma, so a metadata event closes the array
+    char buf[128];
+    int len = snprintf(buf, sizeof(buf),
+            "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"mymake\"}}\n]\n", trace_pid);
+    write_all(buf, len);
+    close(trace_fd);
+    trace_fd = -1;
+
+    if (succeeded) {
+        print_critical_path(critical_end, wall_us);
+    }
+}
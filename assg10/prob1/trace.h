@@ -0,0 +1,15 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "graph.h"
+
+// Function prototypes
+int trace_open(const char *path);
+int trace_enabled(void);
+long long trace_now(void);
+void trace_span(const char *name, const char *category, long long start_us, long long end_us);
+void trace_stat(long long start_us);
+void trace_completed(Node *node, long long start_us, long long end_us);
+void trace_close(int succeeded);
+
+#endif
@@ -0,0 +1,321 @@
+/*
+ * File: watch.c
+ * Author: Andy Siegel
+ * Purpose: Keeps the parsed graph around and rebuilds it as files change
+ * (--watch). Every file the build read without a rule to make it is watched
+ * through inotify on its directory, which also sees editors that save by
+ * renaming a new file over the old one. Changes that arrive close together
+ * are handled as one batch. A change marks the file and everything that
+ * depends on it dirty, and the targets among them are rebuilt without
+ * comparing mtimes, which a change in the same second would not move. Only
+ * dirty nodes are scheduled and stat'd again, the rest of the graph keeps
+ * the state the last build left it in.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include "watch.h"
+
+// A batch is complete once no event has come in for this long
+#define DEBOUNCE_MS 100
+
+// Everything that can replace or change a file in a directory
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE | IN_ATTRIB)
+
+// A watched directory and how the node names in it spell it, including
+// the final slash ("" for the current directory)
+typedef struct WatchDir {
+    int wd;
+    char *prefix;
+} WatchDir;
+
+// Growable list of nodes
+typedef struct NodeArray {
+    Node **items;
+    int count;
+    int capacity;
+} NodeArray;
+
+static int inotify_fd = -1;
+static WatchDir *dirs = NULL;
+static int num_dirs = 0;
+static int dirs_capacity = 0;
+static NodeArray files = {NULL, 0, 0};  // Watched files
+static NodeArray dirty = {NULL, 0, 0};  // Work list while marking dirty nodes
+static char *path_buf = NULL;
+static size_t path_capacity = 0;
+
+/* append_node(NodeArray *arr, Node *node) - appends a node to the array, growing it as needed */
+static void append_node(NodeArray *arr, Node *node) {
+    if (arr->count == arr->capacity) {
+        int new_capacity = arr->capacity == 0 ? 64 : arr->capacity * 2;
+        Node **new_items = realloc(arr->items, sizeof(Node*) * new_capacity);
+        if (new_items == NULL) {
+            perror("realloc for watch list");
+            exit(1);
+        }
+        arr->items = new_items;
+        arr->capacity = new_capacity;
+    }
+    arr->items[arr->count++] = node;
+}
+
+/* watch_open() - starts an inotify instance for --watch. Returns 0 on success and -1 on failure. */
+int watch_open(void) {
+    inotify_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (inotify_fd < 0) {
+        perror("inotify_init1");
+        return -1;
+    }
+    return 0;
+}
+
+/* watch_dir_of(Node *node) - makes sure the directory holding node is watched */
+static void watch_dir_of(Node *node) {
+    const char *slash = strrchr(node->name, '/');
+    size_t prefix_len = slash == NULL ? 0 : (size_t)(slash - node->name) + 1;
+    for (int i = 0; i < num_dirs; i++) {
+        if (strlen(dirs[i].prefix) == prefix_len && strncmp(dirs[i].prefix, node->name, prefix_len) == 0) {
+            return;
+        }
+    }
+
+    char *prefix = malloc(prefix_len + 2);
+    if (prefix == NULL) {
+        perror("malloc for watch");
+        exit(1);
+    }
+    memcpy(prefix, node->name, prefix_len);
+    prefix[prefix_len] = '\0';
+
+    // The directory itself is the prefix without its slash, except for "/"
+    char *dir = prefix_len == 0 ? "." : prefix;
+    if (prefix_len > 1) {
+        prefix[prefix_len - 1] = '\0';
+    }
+    int wd = inotify_add_watch(inotify_fd, dir, WATCH_MASK);
+    if (wd < 0) {
+        fprintf(stderr, "mymake: warning: cannot watch '%s': %s\n", dir, strerror(errno));
+    }
+    if (prefix_len > 1) {
+        prefix[prefix_len - 1] = '/';
+    }
+
+    if (num_dirs == dirs_capacity) {
+        int new_capacity = dirs_capacity == 0 ? 16 : dirs_capacity * 2;
+        WatchDir *new_dirs = realloc(dirs, sizeof(WatchDir) * new_capacity);
+        if (new_dirs == NULL) {
+            perror("realloc for watch");
+            exit(1);
+        }
+        dirs = new_dirs;
+        dirs_capacity = new_capacity;
+    }
+    dirs[num_dirs].wd = wd;
+    dirs[num_dirs].prefix = prefix;
+    num_dirs++;
+}
+
+/* watch_graph(NodeTable *table) - adds the nodes the builds reached since the last call: their edges go into
+ * the watchers lists of their dependencies, and files without a rule are watched */
+void watch_graph(NodeTable *table) {
+    for (size_t i = 0; i < table->capacity; i++) {
+        Node *node = table->slots[i];
+        if (node == NULL || !node->visited || node->watched) {
+            continue;
+        }
+        node->watched = 1;
+        for (int j = 0; j < node->num_dependencies; j++) {
+            Node *dep = node->dependencies[j];
+            dep->watchers = arena_grow(&table->arena, dep->watchers, dep->num_watchers,
+                    &dep->watchers_capacity, sizeof(Node*));
+            dep->watchers[dep->num_watchers++] = node;
+        }
+        // Targets are written by the build itself, so only leaf files are watched
+        if (!node->is_target) {
+            watch_dir_of(node);
+            append_node(&files, node);
+        }
+    }
+}
+
+/* mark_dirty(Node *node) - queues node to be rebuilt, unless it already is */
+static void mark_dirty(Node *node) {
+    if (!node->dirty) {
+        node->dirty = 1;
+        append_node(&dirty, node);
+    }
+}
+
+/* file_changed(NodeTable *table, int wd, const char *name) - marks the watched file name in the directory
+ * wd dirty, returns 1 if it is one of ours */
+static int file_changed(NodeTable *table, int wd, const char *name) {
+    int found = 0;
+    for (int i = 0; i < num_dirs; i++) {
+        if (dirs[i].wd != wd) {
+            continue;
+        }
+        size_t len = strlen(dirs[i].prefix) + strlen(name) + 1;
+        if (len > path_capacity) {
+            char *new_buf = realloc(path_buf, len);
+            if (new_buf == NULL) {
+                perror("realloc for watch");
+                exit(1);
+            }
+            path_buf = new_buf;
+            path_capacity = len;
+        }
+        snprintf(path_buf, len, "%s%s", dirs[i].prefix, name);
+        Node *node = find_node(table, path_buf);
+        if (node != NULL && node->watched && !node->is_target) {
+            if (!node->dirty) {
+                printf("mymake: '%s' changed.\n", node->name);
+            }
+            mark_dirty(node);
+            found = 1;
+        }
+    }
+    return found;
+}
+
+/* read_events(NodeTable *table) - handles every event waiting on the inotify instance. Returns how many
+ * watched files changed, or -1 on failure. */
+static int read_events(NodeTable *table) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int changed = 0;
+    while (1) {
+        ssize_t n = read(inotify_fd, buf, sizeof(buf));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) break;
+            perror("read inotify");
+            return -1;
+        }
+        for (char *p = buf; p < buf + n; ) {
+            struct inotify_event *event = (struct inotify_event*)p;
+            if (event->mask & IN_Q_OVERFLOW) {
+                // Events were lost, so any file may have changed
+                for (int i = 0; i < files.count; i++) {
+                    mark_dirty(files.items[i]);
+                }
+                changed += files.count;
+            } else if (event->len > 0) {
+                changed += file_changed(table, event->wd, event->name);
+            }
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    return changed;
+}
+
+/* reset_node(Node *node) - forgets what the last build found out about node, so the next one redoes it */
+static void reset_node(Node *node) {
+    node->visited = 0;
+    node->order = -1;
+    node->completed = 0;
+    node->num_dependents = 0;
+    node->pending = 0;
+    node->build_us = 0;
+    node->path_us = 0;
+    node->path_next = NULL;
+    node->depth = 0;
+    node->dirty = 0;
+}
+
+/* mark_downstream(int start, int changed) - marks everything that depends on the dirty nodes from index start on
+ * dirty as well; if changed, those nodes are changed files and everything found is set to be built */
+static void mark_downstream(int start, int changed) {
+    for (int i = start; i < dirty.count; i++) {
+        Node *node = dirty.items[i];
+        Node *cause = node->is_target ? node->reason_dep : node;
+        for (int j = 0; j < node->num_watchers; j++) {
+            if (changed) {
+                set_must_build(node->watchers[j], REASON_DEP_CHANGED, cause);
+            }
+            mark_dirty(node->watchers[j]);
+        }
+    }
+}
+
+/* wait_for_changes(NodeTable *table) - blocks until watched files change and no more changes follow within
+ * the debounce window, then resets the changed files and everything downstream of them, so building a goal
+ * again only redoes that part. Returns how many nodes were reset, or -1 on failure. */
+int wait_for_changes(NodeTable *table) {
+    printf("mymake: watching %d files for changes.\n", files.count);
+    fflush(stdout);
+
+    int changed = 0;
+    while (1) {
+        struct pollfd pfd = {inotify_fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, changed > 0 ? DEBOUNCE_MS : -1);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            return -1;
+        }
+        if (ready == 0) {
+            break;
+        }
+        int n = read_events(table);
+        if (n < 0) {
+            return -1;
+        }
+        changed += n;
+    }
+
+    // must_build only describes the last build; a clean node is not rebuilt again
+    for (size_t i = 0; i < table->capacity; i++) {
+        Node *node = table->slots[i];
+        if (node != NULL) {
+            node->must_build = 0;
+            node->reason = REASON_NONE;
+            node->reason_dep = NULL;
+        }
+    }
+
+    // Everything downstream of a changed file is rebuilt outright: a change
+    // made in the same second as the last build leaves mtimes that do not
+    // look newer, so comparing them again would miss it
+    mark_downstream(0, 1);
+
+    // Nodes a failed build never finished have to be tried again as well
+    int start = dirty.count;
+    for (size_t i = 0; i < table->capacity; i++) {
+        Node *node = table->slots[i];
+        if (node != NULL && node->visited && !node->completed) {
+            mark_dirty(node);
+        }
+    }
+    mark_downstream(start, 0);
+
+    int count = dirty.count;
+    for (int i = 0; i < dirty.count; i++) {
+        reset_node(dirty.items[i]);
+    }
+    dirty.count = 0;
+    fflush(stdout);
+    return count;
+}
+
+/* watch_close() - stops watching and frees everything --watch allocated */
+void watch_close(void) {
+    if (inotify_fd >= 0) {
+        close(inotify_fd);
+        inotify_fd = -1;
+    }
+    for (int i = 0; i < num_dirs; i++) {
+        free(dirs[i].prefix);
+    }
+    free(dirs);
+    dirs = NULL;
+    num_dirs = 0;
+    dirs_capacity = 0;
+    free(files.items);
+    free(dirty.items);
+    free(path_buf);
+}
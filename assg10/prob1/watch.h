@@ -0,0 +1,12 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "graph.h"
+
+// Function prototypes
+int watch_open(void);
+void watch_graph(NodeTable *table);
+int wait_for_changes(NodeTable *table);
+void watch_close(void);
+
+#endif
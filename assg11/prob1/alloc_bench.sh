@@ -0,0 +1,63 @@
+#!/bin/bash
+
+# This script counts the memory allocations bacon makes per query. Each executable loads a
+# generated file of MOVIES movies (like the files of bench.sh) once without queries and
+# once with QUERIES queries, with alloc_count.c preloaded to count calls to malloc, calloc
+# and realloc. The difference, divided by the number of queries, is what answering one
+# query costs. Queries search the linked lists from Kevin Bacon and print the path
+# (--layout=lists --search=forward -l), so give it executables that know those options, for
+# example bacon built before and after a change.
+#
+# Usage: ./alloc_bench.sh [bacon executable...]
+
+# --- Configuration ---
+SCRIPT_DIR=$(dirname "$(realpath "$0")")
+EXECS="${@:-./bacon}"
+MOVIES=${MOVIES:-20000}
+QUERIES=${QUERIES:-200}
+OPTIONS="--layout=lists --search=forward -l"
+BENCH_DIR=$(mktemp -d)
+
+gcc -Wall -O2 -shared -fPIC "$SCRIPT_DIR/alloc_count.c" -o "$BENCH_DIR/alloc_count.so" || exit 1
+
+# --- Generate the movie file and the queries, as bench.sh does ---
+awk -v n="$MOVIES" 'BEGIN {
+    srand(352);
+    for (i = 1; i <= n; i++) {
+        printf "Movie: Movie %d\n", i;
+        cast = 3 + int(rand() * 8);
+        for (j = 0; j < cast; j++) {
+            r = rand();
+            actor = int(2 * n * r * r);
+            if (actor == 0) print "Kevin Bacon";
+            else printf "Actor %d\n", actor;
+        }
+        print "";
+    }
+}' > "$BENCH_DIR/movies.txt"
+grep -v '^Movie:' "$BENCH_DIR/movies.txt" | grep -v '^$' | sort -u | awk -v q="$QUERIES" 'BEGIN { srand(11) } { names[NR] = $0 } END {
+    for (i = 0; i < q; i++) print names[int(rand() * NR) + 1];
+}' > "$BENCH_DIR/queries.txt"
+
+# --- Count the allocations of $1 with the queries in $2 ---
+count_allocations() {
+    LD_PRELOAD="$BENCH_DIR/alloc_count.so" "$1" $OPTIONS "$BENCH_DIR/movies.txt" < "$2" 2>&1 >/dev/null |
+        grep '^alloc_count:' | awk '{ print $2 }'
+}
+
+# --- Start of Script ---
+echo "Counting allocations with $MOVIES movies and $QUERIES queries ($OPTIONS)"
+printf "%-40s %12s %14s %12s\n" "executable" "load" "with queries" "per query"
+
+for exec in $EXECS; do
+    load=$(count_allocations "$exec" /dev/null)
+    total=$(count_allocations "$exec" "$BENCH_DIR/queries.txt")
+    if [ -z "$load" ] || [ -z "$total" ]; then
+        echo "Could not count the allocations of $exec"
+        continue
+    fi
+    awk -v x="$exec" -v l="$load" -v t="$total" -v q="$QUERIES" \
+        'BEGIN { printf "%-40s %12d %14d %12.1f\n", x, l, t, (t - l) / q }'
+done
+
+rm -rf "$BENCH_DIR"
@@ -0,0 +1,43 @@
+/*
+ * File: alloc_count.c
+ * Author: Andy Siegel
+ * Purpose: Counts how often a program allocates memory, for alloc_bench.sh.
+ * It is built as a shared library and loaded with LD_PRELOAD, where its
+ * malloc, calloc and realloc count each call and pass it on to the C
+ * library. The counts are printed to stderr when the program exits.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+
+// The C library's own allocator, which these wrappers call
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static long mallocs = 0;
+static long callocs = 0;
+static long reallocs = 0;
+
+void *malloc(size_t size) {
+    __atomic_add_fetch(&mallocs, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    __atomic_add_fetch(&callocs, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    __atomic_add_fetch(&reallocs, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(ptr, size);
+}
+
+/* report() - prints the counts once the program has exited */
+static void __attribute__((destructor)) report(void) {
+    long total = mallocs + callocs + reallocs;
+    fprintf(stderr, "alloc_count: %ld allocations (%ld malloc, %ld calloc, %ld realloc)\n",
+            total, mallocs, callocs, reallocs);
+}
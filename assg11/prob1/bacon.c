@@ -7,408 +7,458 @@
  * The program then uses a Breadth-First Search (BFS) to find the shortest
  * path from a given actor to "Kevin Bacon". It supports an optional '-l'
  * flag to print the path of actors and movies.
+ *
+ * Scores are found with a bidirectional search by default. The path printed
+ * with -l is the one the search from Kevin Bacon finds, so -l still runs
+ * that search. --search=forward uses it for scores as well, and --stats
+ * reports how many actors were visited.
+ *
+ * For large batches of queries, --search=tree searches the whole graph from
+ * Kevin Bacon once, right after loading it. Every actor keeps its level and
+ * predecessor from that search, so each query is a lookup plus, with -l, a
+ * walk back along the predecessors. Without -l only levels are needed, and
+ * the packed graph is searched top-down and bottom-up (csr_levels).
+ *
+ * --histogram prints how many actors have each score, and how many have
+ * no path to Kevin Bacon, instead of answering queries.
+ *
+ * --center NAME scores actors against NAME instead of Kevin Bacon; NAME
+ * has to be in the graph. --rank-centers K ranks K sampled actors by how
+ * close they are to the rest of the graph (centers.c), on -t threads.
+ *
+ * Once the file is read the graph is packed into flat arrays (csr.c) and
+ * searched there. --layout=lists searches the linked structures the file
+ * was read into instead, to compare the two.
+ *
+ * With -t N queries are answered in batches by N threads (pool.c), and
+ * printed in the order they were read.
+ *
+ * --build-index=FILE saves the packed graph to an index file instead of
+ * answering queries (snapshot.c). Given an index file in place of a movie
+ * file, bacon maps it in and starts answering queries without reading the
+ * movie file at all.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "graph.h"
+#include "csr.h"
+#include "pool.h"
+#include "snapshot.h"
+#include "centers.h"
 
-// Forward declarations for structs
-struct Actor;
-struct Movie;
+// Queries read and answered together with -t
+#define QUERY_BATCH 1024
 
 /*
- * MovieActorLink is a node in a linked list connecting an actor to a movie
- * they were in.
+ * score_with_lists(mode, l_option, all_actors, kevin_bacon, actor) -- Finds
+ * the score of an actor by searching the linked structures. Returns -1 for
+ * no path. Afterwards print_path can print the path when l_option is set.
  */
-struct MovieActorLink {
-    struct Movie *movie;
-    struct MovieActorLink *next;
-};
-
-/*
- * Actor is a vertex in the graph, representing a person.
- */
-struct Actor {
-    char *name;
-    struct MovieActorLink *movies; // List of movies this actor was in
-    struct Actor *next;           // For the global list of all actors
-
-    // BFS-related fields
-    int visited;
-    int level;
-    struct Actor *prev_actor_in_path;
-    struct Movie *prev_movie_in_path;
-};
-
-/*
- * ActorMovieLink is a node in a linked list connecting a movie to an actor
- * who appeared in it.
- */
-struct ActorMovieLink {
-    struct Actor *actor;
-    struct ActorMovieLink *next;
-};
-
-/*
- * Movie is an edge in the graph, representing a film.
- */
-struct Movie {
-    char *name;
-    struct ActorMovieLink *actors; // List of actors in this movie
-    struct Movie *next;          // For the global list of all movies
-};
-
-/*
- * QueueNode is a node for the queue used in BFS.
- */
-struct QueueNode {
-    struct Actor *actor;
-    struct QueueNode *next;
-};
-
-/*
- * Queue represents a simple FIFO queue for the BFS algorithm.
- */
-struct Queue {
-    struct QueueNode *front;
-    struct QueueNode *rear;
-};
-
-/*
- * find_actor(head, name) -- Searches for an actor by name in a linked list.
- */
-struct Actor* find_actor(struct Actor *head, const char *name) {
-    struct Actor *current = head;
-    while (current != NULL) {
-        if (strcmp(current->name, name) == 0) {
-            return current;
-        }
-        current = current->next;
+int score_with_lists(enum SearchMode mode, int l_option, struct Actor *all_actors, struct Actor *kevin_bacon,
+        struct Actor *actor) {
+    // The path -l prints comes from the tree the search from Kevin Bacon builds
+    if (mode == SEARCH_TREE) {
+        return actor->level;
+    } else if (l_option || mode == SEARCH_FORWARD) {
+        return bfs(all_actors, kevin_bacon, actor);
+    } else {
+        return bidirectional_bfs(kevin_bacon, actor);
     }
-    return NULL;
 }
 
 /*
- * add_actor(head_ptr, name) -- Creates and adds a new actor to a list if
- * they don't already exist.
- * @param head_ptr A pointer to the head of the actor list.
- * @param name The name of the actor to add.
- * @return A pointer to the new or existing Actor struct. Exits on memory failure.
+ * print_histogram(counts, num_levels, unreachable) -- Prints how many actors
+ * have each score, then how many have no path to Kevin Bacon.
  */
-struct Actor* add_actor(struct Actor **head_ptr, const char *name) {
-    struct Actor *actor = find_actor(*head_ptr, name);
-    if (actor == NULL) {
-        actor = malloc(sizeof(struct Actor));
-        if (!actor) {
-            fprintf(stderr, "Memory allocation failed for actor.\n");
-            exit(1);
-        }
-        actor->name = strdup(name);
-        if (!actor->name) {
-            fprintf(stderr, "Memory allocation failed for actor name.\n");
-            exit(1);
-        }
-        actor->movies = NULL;
-        actor->next = *head_ptr;
-        *head_ptr = actor;
+void print_histogram(const long *counts, int num_levels, long unreachable) {
+    for (int level = 0; level < num_levels; level++) {
+        printf("Score %d: %ld\n", level, counts[level]);
     }
-    return actor;
+    printf("No Bacon: %ld\n", unreachable);
 }
 
 /*
- * add_movie(head_ptr, name) -- Creates and adds a new movie to a list.
- * @param head_ptr A pointer to the head of the movie list.
- * @param name The name of the movie to add.
- * @return A pointer to the new Movie struct. Exits on memory failure.
+ * histogram_with_lists(all_actors, kevin_bacon) -- Prints the histogram of
+ * scores after one bfs over the linked structures from Kevin Bacon, which
+ * may be NULL.
  */
-struct Movie* add_movie(struct Movie **head_ptr, const char *name) {
-    struct Movie *movie = malloc(sizeof(struct Movie));
-    if (!movie) {
-        fprintf(stderr, "Memory allocation failed for movie.\n");
-        exit(1);
+void histogram_with_lists(struct Actor *all_actors, struct Actor *kevin_bacon) {
+    if (kevin_bacon != NULL) {
+        bfs(all_actors, kevin_bacon, NULL);
     }
-    movie->name = strdup(name);
-    if (!movie->name) {
-        fprintf(stderr, "Memory allocation failed for movie name.\n");
+    int num_levels = 0;
+    for (struct Actor *a = all_actors; a != NULL; a = a->next) {
+        if (kevin_bacon != NULL && a->level + 1 > num_levels) {
+            num_levels = a->level + 1;
+        }
+    }
+    long *counts = calloc(num_levels + 1, sizeof(long));
+    if (!counts) {
+        fprintf(stderr, "Memory allocation failed for histogram.\n");
         exit(1);
     }
-    movie->actors = NULL;
-    movie->next = *head_ptr;
-    *head_ptr = movie;
-    return movie;
-}
-
-/*
- * link_actor_and_movie(actor, movie) -- Creates a bidirectional link
- * between an actor and a movie.
- */
-void link_actor_and_movie(struct Actor *actor, struct Movie *movie) {
-    // Add movie to actor's list
-    struct MovieActorLink *new_movie_link = malloc(sizeof(struct MovieActorLink));
-    if (!new_movie_link) exit(1);
-    new_movie_link->movie = movie;
-    new_movie_link->next = actor->movies;
-    actor->movies = new_movie_link;
-
-    // Add actor to movie's list
-    struct ActorMovieLink *new_actor_link = malloc(sizeof(struct ActorMovieLink));
-    if (!new_actor_link) exit(1);
-    new_actor_link->actor = actor;
-    new_actor_link->next = movie->actors;
-    movie->actors = new_actor_link;
-}
-
-/*
- * create_queue() -- Creates and initializes an empty queue.
- */
-struct Queue* create_queue() {
-    struct Queue *q = malloc(sizeof(struct Queue));
-    if (!q) exit(1);
-    q->front = q->rear = NULL;
-    return q;
-}
-
-/*
- * enqueue(q, actor) -- Adds an actor to the rear of the queue.
- */
-void enqueue(struct Queue *q, struct Actor *actor) {
-    struct QueueNode *newNode = malloc(sizeof(struct QueueNode));
-    if (!newNode) exit(1);
-    newNode->actor = actor;
-    newNode->next = NULL;
-    if (q->rear == NULL) {
-        q->front = q->rear = newNode;
-        return;
+    long unreachable = 0;
+    for (struct Actor *a = all_actors; a != NULL; a = a->next) {
+        if (kevin_bacon != NULL && a->level >= 0) {
+            counts[a->level]++;
+        } else {
+            unreachable++;
+        }
     }
-    q->rear->next = newNode;
-    q->rear = newNode;
+    print_histogram(counts, num_levels, unreachable);
+    free(counts);
 }
 
 /*
- * dequeue(q) -- Removes an actor from the front of the queue.
+ * histogram_with_csr(csr, search, kevin_bacon) -- Prints the histogram of
+ * scores after one csr_levels search of the packed graph from Kevin Bacon,
+ * which may be -1.
  */
-struct Actor* dequeue(struct Queue *q) {
-    if (q->front == NULL) return NULL;
-    struct QueueNode *temp = q->front;
-    struct Actor *actor = temp->actor;
-    q->front = q->front->next;
-    if (q->front == NULL) {
-        q->rear = NULL;
+void histogram_with_csr(struct CsrGraph *csr, struct CsrSearch *search, int kevin_bacon) {
+    int num_levels = 0;
+    if (kevin_bacon != -1) {
+        num_levels = csr_levels(csr, search, kevin_bacon) + 1;
     }
-    free(temp);
-    return actor;
-}
-
-/*
- * free_queue(q) -- Frees all memory associated with a queue.
- */
-void free_queue(struct Queue* q) {
-    while(dequeue(q) != NULL);
-    free(q);
-}
-
-/*
- * bfs(start_actor, end_actor_name) -- Performs a Breadth-First Search to find the
- * shortest path from a starting actor to a target actor.
- */
-int bfs(struct Actor *all_actors, struct Actor *start_actor, struct Actor *end_actor) {
-    if (start_actor == end_actor) return 0;
-
-    // Reset BFS state for all actors
-    for (struct Actor *a = all_actors; a != NULL; a = a->next) {
-        a->visited = 0;
-        a->level = -1;
-        a->prev_actor_in_path = NULL;
-        a->prev_movie_in_path = NULL;
+    long *counts = calloc(num_levels + 1, sizeof(long));
+    if (!counts) {
+        fprintf(stderr, "Memory allocation failed for histogram.\n");
+        exit(1);
     }
-
-    struct Queue *q = create_queue();
-    start_actor->visited = 1;
-    start_actor->level = 0;
-    enqueue(q, start_actor);
-
-    while (q->front != NULL) {
-        struct Actor *current_actor = dequeue(q);
-        if (current_actor == end_actor) {
-            int level = current_actor->level;
-            free_queue(q);
-            return level;
-        }
-
-        // Iterate through movies of the current actor
-        for (struct MovieActorLink *ml = current_actor->movies; ml != NULL; ml = ml->next) {
-            struct Movie *current_movie = ml->movie;
-            // Iterate through co-stars in that movie
-            for (struct ActorMovieLink *al = current_movie->actors; al != NULL; al = al->next) {
-                struct Actor *costar = al->actor;
-                if (!costar->visited) {
-                    costar->visited = 1;
-                    costar->level = current_actor->level + 1;
-                    costar->prev_actor_in_path = current_actor;
-                    costar->prev_movie_in_path = current_movie;
-                    enqueue(q, costar);
-                }
-            }
+    long reached = 0;
+    if (kevin_bacon != -1) {
+        for (int i = 0; i < search->queue_len; i++) {
+            counts[search->level[search->queue[i]]]++;
         }
+        reached = search->queue_len;
     }
-    free_queue(q);
-    return -1; // No path found
+    print_histogram(counts, num_levels, csr->num_actors - reached);
+    free(counts);
 }
 
 /*
- * print_path(actor) -- Prints the path from the queried actor back to Kevin Bacon.
+ * answer_in_batches(pool, searches) -- Reads the queries on
+ * stdin in batches, answers each batch on the pool's threads and prints
+ * the answers in input order. Returns 1 if an actor was not found.
  */
-void print_path(struct Actor *actor) {
-    // Build the path by following prev pointers
-    struct Actor *path[1000];
-    struct Movie *movies[1000];
-    int path_len = 0;
-    
-    struct Actor *current = actor;
-    while (current != NULL) {
-        path[path_len] = current;
-        if (current->prev_actor_in_path != NULL) {
-            movies[path_len] = current->prev_movie_in_path;
-        }
-        path_len++;
-        current = current->prev_actor_in_path;
-    }
-    
-    // Print from queried actor (path[0]) to Kevin Bacon (path[path_len-1])
-    printf("%s\n", path[0]->name);
-    for (int i = 0; i < path_len - 1; i++) {
-        printf("was in %s with\n", movies[i]->name);
-        printf("%s\n", path[i + 1]->name);
+int answer_in_batches(struct QueryPool *pool, long *searches) {
+    struct Query *batch = malloc(sizeof(struct Query) * QUERY_BATCH);
+    if (!batch) {
+        fprintf(stderr, "Memory allocation failed for queries.\n");
+        exit(1);
     }
-}
 
-/*
- * free_graph(actors, movies) -- Frees all dynamically allocated memory for
- * the entire graph.
- */
-void free_graph(struct Actor *actors, struct Movie *movies) {
-    struct Actor *current_actor = actors;
-    while (current_actor != NULL) {
-        struct Actor *next_actor = current_actor->next;
-        free(current_actor->name);
-        struct MovieActorLink *current_movie_link = current_actor->movies;
-        while (current_movie_link != NULL) {
-            struct MovieActorLink *next_link = current_movie_link->next;
-            free(current_movie_link);
-            current_movie_link = next_link;
+    int non_fatal_error = 0;
+    int done = 0;
+    while (!done) {
+        int num_queries = 0;
+        while (num_queries < QUERY_BATCH) {
+            // Each query keeps its own line until the batch is printed
+            char *line = NULL;
+            size_t len = 0;
+            ssize_t read = getline(&line, &len, stdin);
+            if (read == -1) {
+                free(line);
+                done = 1;
+                break;
+            }
+            if (line[read - 1] == '\n') line[read - 1] = '\0';
+
+            struct Query *query = &batch[num_queries++];
+            query->name = line;
+            query->actor = csr_find_actor(pool->csr, line);
+            query->output = NULL;
+            query->output_len = 0;
+            if (query->actor != -1 && pool->kevin_bacon != -1 && pool->mode != SEARCH_TREE) {
+                (*searches)++;
+            }
         }
-        free(current_actor);
-        current_actor = next_actor;
-    }
 
-    struct Movie *current_movie = movies;
-    while (current_movie != NULL) {
-        struct Movie *next_movie = current_movie->next;
-        free(current_movie->name);
-        struct ActorMovieLink *current_actor_link = current_movie->actors;
-        while (current_actor_link != NULL) {
-            struct ActorMovieLink *next_link = current_actor_link->next;
-            free(current_actor_link);
-            current_actor_link = next_link;
+        run_batch(pool, batch, num_queries);
+
+        for (int i = 0; i < num_queries; i++) {
+            if (batch[i].actor == -1) {
+                fprintf(stderr, "Error: Actor '%s' not found in the graph.\n", batch[i].name);
+                non_fatal_error = 1;
+            } else {
+                fwrite(batch[i].output, 1, batch[i].output_len, stdout);
+            }
+            free(batch[i].name);
+            free(batch[i].output);
         }
-        free(current_movie);
-        current_movie = next_movie;
     }
-}
 
+    free(batch);
+    return non_fatal_error;
+}
 
 int main(int argc, char *argv[]) {
     char *filename = NULL;
     int l_option = 0;
+    enum SearchMode search_mode = SEARCH_BIDIRECTIONAL;
+    int stats_option = 0;
+    int lists_layout = 0;
+    int num_threads = 0;
+    char *index_file = NULL;
+    int histogram_option = 0;
+    const char *center_name = "Kevin Bacon";
+    int center_given = 0;
+    int rank_k = 0;
 
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-l") == 0) {
             l_option = 1;
+        } else if (strcmp(argv[i], "--search=forward") == 0) {
+            search_mode = SEARCH_FORWARD;
+        } else if (strcmp(argv[i], "--search=bidirectional") == 0) {
+            search_mode = SEARCH_BIDIRECTIONAL;
+        } else if (strcmp(argv[i], "--search=tree") == 0) {
+            search_mode = SEARCH_TREE;
+        } else if (strcmp(argv[i], "--layout=lists") == 0) {
+            lists_layout = 1;
+        } else if (strcmp(argv[i], "--layout=csr") == 0) {
+            lists_layout = 0;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            stats_option = 1;
+        } else if (strcmp(argv[i], "--histogram") == 0) {
+            histogram_option = 1;
+        } else if (strncmp(argv[i], "--build-index=", 14) == 0 && argv[i][14] != '\0') {
+            index_file = argv[i] + 14;
+        } else if (strcmp(argv[i], "--center") == 0 && i + 1 < argc) {
+            center_name = argv[++i];
+            center_given = 1;
+        } else if (strcmp(argv[i], "--rank-centers") == 0 && i + 1 < argc) {
+            rank_k = atoi(argv[++i]);
+            if (rank_k < 1) {
+                fprintf(stderr, "Error: --rank-centers needs a number of actors, not '%s'\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            num_threads = atoi(argv[++i]);
+            if (num_threads < 1) {
+                fprintf(stderr, "Error: -t needs a number of threads, not '%s'\n", argv[i]);
+                return 1;
+            }
         } else if (argv[i][0] == '-') {
-            fprintf(stderr, "Usage: bacon [-l] movie_file\n");
+            fprintf(stderr, "Usage: bacon [-l] [-t threads] [--search=forward|bidirectional|tree] [--layout=csr|lists] [--stats] [--center name] [--histogram] [--rank-centers k] [--build-index=index_file] movie_file\n");
             return 1;
         } else if (filename == NULL) {
             filename = argv[i];
         } else {
-            fprintf(stderr, "Usage: bacon [-l] movie_file\n");
+            fprintf(stderr, "Usage: bacon [-l] [-t threads] [--search=forward|bidirectional|tree] [--layout=csr|lists] [--stats] [--center name] [--histogram] [--rank-centers k] [--build-index=index_file] movie_file\n");
             return 1;
         }
     }
 
     if (filename == NULL) {
-        fprintf(stderr, "Usage: bacon [-l] movie_file\n");
+        fprintf(stderr, "Usage: bacon [-l] [-t threads] [--search=forward|bidirectional|tree] [--layout=csr|lists] [--stats] [--center name] [--histogram] [--rank-centers k] [--build-index=index_file] movie_file\n");
         return 1;
     }
 
-    FILE *file = fopen(filename, "r");
-    if (!file) {
-        fprintf(stderr, "Error: Cannot open file %s\n", filename);
+    if (num_threads > 0 && lists_layout) {
+        fprintf(stderr, "Error: -t searches the packed graph, so it cannot be used with --layout=lists\n");
+        return 1;
+    }
+    if (rank_k > 0 && lists_layout) {
+        fprintf(stderr, "Error: --rank-centers searches the packed graph, so it cannot be used with --layout=lists\n");
+        return 1;
+    }
+    if (rank_k > 0 && center_given) {
+        fprintf(stderr, "Error: --rank-centers picks its own centers, so it cannot be used with --center\n");
+        return 1;
+    }
+
+    struct CsrGraph csr;
+    int from_index = load_snapshot(filename, &csr);
+    if (from_index < 0) {
+        return 1;
+    }
+    if (from_index && lists_layout) {
+        fprintf(stderr, "Error: An index file only holds the packed graph, so it cannot be used with --layout=lists\n");
+        free_csr(&csr);
         return 1;
     }
 
     struct Actor *all_actors = NULL;
     struct Movie *all_movies = NULL;
+    struct ActorIndex actor_index;
+    struct StringPool names = {NULL};
+    init_index(&actor_index);
     char *line = NULL;
     size_t len = 0;
     ssize_t read;
-    struct Movie *current_movie = NULL;
 
-    // Read file and build graph
-    while ((read = getline(&line, &len, file)) != -1) {
-        if (line[read - 1] == '\n') line[read - 1] = '\0'; // Strip newline
+    if (!from_index) {
+        FILE *file = fopen(filename, "r");
+        if (!file) {
+            fprintf(stderr, "Error: Cannot open file %s\n", filename);
+            return 1;
+        }
 
-        if (strncmp(line, "Movie: ", 7) == 0) {
-            current_movie = add_movie(&all_movies, line + 7);
-        } else if (strlen(line) > 0 && current_movie != NULL) {
-            struct Actor *actor = add_actor(&all_actors, line);
-            link_actor_and_movie(actor, current_movie);
+        struct Movie *current_movie = NULL;
+        // Read file and build graph
+        while ((read = getline(&line, &len, file)) != -1) {
+            if (line[read - 1] == '\n') line[read - 1] = '\0'; // Strip newline
+
+            if (strncmp(line, "Movie: ", 7) == 0) {
+                current_movie = add_movie(&all_movies, &names, line + 7);
+            } else if (strlen(line) > 0 && current_movie != NULL) {
+                struct Actor *actor = add_actor(&all_actors, &actor_index, &names, line);
+                link_actor_and_movie(actor, current_movie);
+            }
+        }
+        free(line);
+        fclose(file);
+
+        if (!lists_layout || index_file != NULL) {
+            build_csr(all_actors, all_movies, &csr);
         }
     }
-    free(line);
-    fclose(file);
 
-    struct Actor *kevin_bacon = find_actor(all_actors, "Kevin Bacon");
-    if (kevin_bacon == NULL) {
-        // Kevin Bacon is not in the data file, so no paths are possible.
-        // We can handle this gracefully.
+    if (index_file != NULL) {
+        int failed = write_snapshot(&csr, index_file);
+        free_csr(&csr);
+        free_graph(all_actors, all_movies);
+        free(actor_index.slots);
+        free_pool(&names);
+        return failed;
+    }
+
+    // Kevin Bacon may not be in the data file, in which case no paths are
+    // possible and every score is "No Bacon!". An actor named with --center
+    // has to be there.
+    struct Actor *kevin_bacon = NULL;
+    int kevin_bacon_id = -1;
+    struct CsrSearch search;
+    if (lists_layout) {
+        kevin_bacon = find_actor(&actor_index, center_name);
+    } else {
+        kevin_bacon_id = csr_find_actor(&csr, center_name);
+        init_csr_search(&csr, &search);
+    }
+    int no_bacon = kevin_bacon == NULL && kevin_bacon_id == -1;
+    if (no_bacon && center_given) {
+        fprintf(stderr, "Error: Actor '%s' not found in the graph.\n", center_name);
+        if (!lists_layout) {
+            free_csr_search(&search);
+            free_csr(&csr);
+        }
+        free_graph(all_actors, all_movies);
+        free(actor_index.slots);
+        free_pool(&names);
+        return 1;
     }
 
     int non_fatal_error = 0;
+    long searches = 0;
+    long centers_visited = 0;
+    if (rank_k > 0) {
+        centers_visited = rank_centers(&csr, rank_k, num_threads > 0 ? num_threads : 1);
+        searches += rank_k < csr.num_actors ? rank_k : csr.num_actors;
+    } else if (histogram_option) {
+        if (lists_layout) {
+            histogram_with_lists(all_actors, kevin_bacon);
+        } else {
+            histogram_with_csr(&csr, &search, kevin_bacon_id);
+        }
+        if (!no_bacon) {
+            searches++;
+        }
+    } else if (search_mode == SEARCH_TREE && !no_bacon) {
+        if (lists_layout) {
+            bfs(all_actors, kevin_bacon, NULL);
+        } else if (l_option) {
+            csr_bfs(&csr, &search, kevin_bacon_id, -1);
+        } else {
+            csr_levels(&csr, &search, kevin_bacon_id);
+        }
+        searches++;
+    }
+
+    // The histogram or the ranking is all those modes print
+    int read_queries = !histogram_option && rank_k == 0;
+    int use_pool = read_queries && num_threads > 0;
+    struct QueryPool pool;
+    if (use_pool) {
+        start_pool(&pool, num_threads, &csr, search_mode, l_option, kevin_bacon_id, &search);
+        non_fatal_error = answer_in_batches(&pool, &searches);
+    }
+
     line = NULL;
     len = 0;
     // Process queries from stdin
-    while ((read = getline(&line, &len, stdin)) != -1) {
+    while (read_queries && !use_pool && (read = getline(&line, &len, stdin)) != -1) {
         if (line[read - 1] == '\n') line[read - 1] = '\0';
         
-        struct Actor *queried_actor = find_actor(all_actors, line);
+        struct Actor *queried_actor = NULL;
+        int queried_id = -1;
+        if (lists_layout) {
+            queried_actor = find_actor(&actor_index, line);
+        } else {
+            queried_id = csr_find_actor(&csr, line);
+        }
 
-        if (queried_actor == NULL) {
+        if (queried_actor == NULL && queried_id == -1) {
             fprintf(stderr, "Error: Actor '%s' not found in the graph.\n", line);
             non_fatal_error = 1;
             continue;
         }
 
-        if (kevin_bacon == NULL) {
+        if (no_bacon) {
              printf("Score: No Bacon!\n");
              continue;
         }
 
-        int score = bfs(all_actors, kevin_bacon, queried_actor);
+        int score;
+        if (lists_layout) {
+            score = score_with_lists(search_mode, l_option, all_actors, kevin_bacon, queried_actor);
+        } else {
+            score = score_with_csr(search_mode, l_option, &csr, &search, kevin_bacon_id, queried_id);
+        }
+        if (search_mode != SEARCH_TREE) {
+            searches++;
+        }
 
         if (score != -1) {
             printf("Score: %d\n", score);
-            if (l_option) {
+            if (l_option && lists_layout) {
                 print_path(queried_actor);
+            } else if (l_option) {
+                csr_print_path(&csr, &search, queried_id, stdout);
             }
         } else {
             printf("Score: No Bacon!\n");
         }
     }
 
+    if (stats_option) {
+        long visited = actors_visited + centers_visited;
+        if (!lists_layout) {
+            visited += search.visited;
+        }
+        if (use_pool) {
+            visited += pool_visited(&pool);
+        }
+        fprintf(stderr, "bacon: %ld searches visited %ld actors (%.1f per search)\n",
+                searches, visited, searches > 0 ? (double)visited / searches : 0.0);
+        if (!lists_layout && search.steps > 0) {
+            fprintf(stderr, "bacon: %ld of %ld steps went bottom-up\n", search.bottom_up_steps, search.steps);
+        }
+    }
+    if (use_pool) {
+        stop_pool(&pool);
+    }
+
     free(line);
+    if (!lists_layout) {
+        free_csr_search(&search);
+        free_csr(&csr);
+    }
     free_graph(all_actors, all_movies);
+    free(actor_index.slots);
+    free_pool(&names);
 
     return non_fatal_error;
 }
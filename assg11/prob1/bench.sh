@@ -0,0 +1,117 @@
+#!/bin/bash
+
+# This script benchmarks bacon on large generated movie files. Each file has N movies
+# with 3 to 10 actors drawn from a pool of 2N actors, where low numbered actors are
+# cast far more often, like the stars of a real movie database. "Kevin Bacon" is
+# actor 0. A sample of actors is queried with each search mode, over both the linked
+# lists and the packed arrays; --stats reports how many actors each search visited. The
+# forward search on the largest file is then repeated with -t for each of THREADS, as is
+# ranking CENTERS sampled actors with --rank-centers, and the file's --histogram is timed
+# over both layouts (a bfs over the lists, or csr_levels). Finally a file with LOAD_MOVIES
+# movies (several million lines) is loaded without queries, to time building the graph,
+# and once more from an index file made with --build-index.
+#
+# Usage: ./bench.sh [bacon executable] [sizes...]
+
+# --- Configuration ---
+BACON_EXEC=$(realpath "${1:-./bacon}")
+shift
+SIZES="${@:-10000 20000 40000}"
+QUERIES=200
+LOAD_MOVIES=${LOAD_MOVIES:-400000}
+CENTERS=${CENTERS:-32}
+THREADS=${THREADS:-1 2 4 8}
+BENCH_DIR=$(mktemp -d)
+
+# --- Generate a movie file with $1 movies into $2 ---
+generate_movies() {
+    awk -v n="$1" 'BEGIN {
+        srand(352);
+        for (i = 1; i <= n; i++) {
+            printf "Movie: Movie %d\n", i;
+            cast = 3 + int(rand() * 8);
+            for (j = 0; j < cast; j++) {
+                r = rand();
+                actor = int(2 * n * r * r);
+                if (actor == 0) print "Kevin Bacon";
+                else printf "Actor %d\n", actor;
+            }
+            print "";
+        }
+    }' > "$2"
+}
+
+# --- Pick $1 actors that appear in movie file $2 ---
+generate_queries() {
+    grep -v '^Movie:' "$2" | grep -v '^$' | sort -u | awk -v q="$1" 'BEGIN { srand(11) } { names[NR] = $0 } END {
+        for (i = 0; i < q; i++) print names[int(rand() * NR) + 1];
+    }'
+}
+
+# --- Start of Script ---
+echo "Benchmarking $BACON_EXEC with $QUERIES queries per file"
+printf "%10s %15s %8s %12s %20s\n" "movies" "search" "layout" "seconds" "actors/search"
+
+for size in $SIZES; do
+    movies="$BENCH_DIR/movies_$size.txt"
+    queries="$BENCH_DIR/queries_$size.txt"
+    generate_movies "$size" "$movies"
+    generate_queries "$QUERIES" "$movies" > "$queries"
+
+    for search in forward bidirectional tree; do
+        for layout in lists csr; do
+            start=$(date +%s.%N)
+            stats=$("$BACON_EXEC" --search=$search --layout=$layout --stats "$movies" < "$queries" 2>&1 >/dev/null | grep '^bacon: .* searches visited')
+            end=$(date +%s.%N)
+            per_search=$(echo "$stats" | sed 's/.*(\([0-9.]*\) per search)/\1/')
+            awk -v n="$size" -v m="$search" -v l="$layout" -v s="$start" -v e="$end" -v v="$per_search" \
+                'BEGIN { printf "%10d %15s %8s %12.3f %20s\n", n, m, l, e - s, v }'
+        done
+    done
+done
+
+echo
+printf "%10s %15s %8s %12s\n" "movies" "search" "threads" "seconds"
+for threads in $THREADS; do
+    start=$(date +%s.%N)
+    "$BACON_EXEC" -t $threads --search=forward "$movies" < "$queries" > /dev/null
+    end=$(date +%s.%N)
+    awk -v n="$size" -v t="$threads" -v s="$start" -v e="$end" \
+        'BEGIN { printf "%10d %15s %8d %12.3f\n", n, "forward", t, e - s }'
+
+    start=$(date +%s.%N)
+    "$BACON_EXEC" -t $threads --rank-centers $CENTERS "$movies" > /dev/null
+    end=$(date +%s.%N)
+    awk -v n="$size" -v t="$threads" -v s="$start" -v e="$end" \
+        'BEGIN { printf "%10d %15s %8d %12.3f\n", n, "rank-centers", t, e - s }'
+done
+
+echo
+printf "%10s %15s %8s %12s\n" "movies" "histogram" "layout" "seconds"
+for layout in lists csr; do
+    start=$(date +%s.%N)
+    "$BACON_EXEC" --histogram --layout=$layout "$movies" > /dev/null
+    end=$(date +%s.%N)
+    awk -v n="$size" -v l="$layout" -v s="$start" -v e="$end" \
+        'BEGIN { printf "%10d %15s %8s %12.3f\n", n, "", l, e - s }'
+done
+
+movies="$BENCH_DIR/movies_load.txt"
+generate_movies "$LOAD_MOVIES" "$movies"
+lines=$(wc -l < "$movies")
+start=$(date +%s.%N)
+"$BACON_EXEC" "$movies" < /dev/null
+end=$(date +%s.%N)
+echo
+awk -v n="$LOAD_MOVIES" -v l="$lines" -v s="$start" -v e="$end" \
+    'BEGIN { printf "Loaded %d movies (%d lines) in %.3f seconds, %.2f us/line\n", n, l, e - s, (e - s) * 1000000 / l }'
+
+index="$BENCH_DIR/movies_load.idx"
+"$BACON_EXEC" --build-index="$index" "$movies"
+start=$(date +%s.%N)
+"$BACON_EXEC" "$index" < /dev/null
+end=$(date +%s.%N)
+awk -v n="$LOAD_MOVIES" -v s="$start" -v e="$end" \
+    'BEGIN { printf "Loaded %d movies from an index file in %.3f seconds\n", n, e - s }'
+
+rm -rf "$BENCH_DIR"
@@ -0,0 +1,133 @@
+/*
+ * File: centers.c
+ * Author: Andy Siegel
+ * Purpose: Ranks actors by how central they are (--rank-centers K). A
+ * sample of K actors is drawn, and each one is searched from with
+ * csr_levels as if it were Kevin Bacon; its mean distance is the mean of
+ * the scores every actor it reaches would get. The searches are spread
+ * over -t threads that share the packed graph, each with its own
+ * CsrSearch, taking the next actor of the sample until none are left.
+ *
+ * An actor whose part of the graph is small has a small mean distance
+ * without being central, so actors that reach more of the graph rank
+ * first, and the mean distance orders those that reach as much.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "centers.h"
+
+/*
+ * measure_center(csr, search, score) -- Searches from score->actor and
+ * fills in how many actors it reaches and their mean distance.
+ */
+static void measure_center(struct CsrGraph *csr, struct CsrSearch *search, struct CenterScore *score) {
+    csr_levels(csr, search, score->actor);
+    long total = 0;
+    for (int i = 0; i < search->queue_len; i++) {
+        total += search->level[search->queue[i]];
+    }
+    score->reached = search->queue_len - 1;
+    score->mean_distance = score->reached > 0 ? (double)total / score->reached : 0.0;
+}
+
+/*
+ * center_thread(arg) -- The loop each thread runs: measure the next actor
+ * of the sample until all of them are taken.
+ */
+static void* center_thread(void *arg) {
+    struct CenterThread *self = arg;
+    struct CenterWork *work = self->work;
+    while (1) {
+        pthread_mutex_lock(&work->lock);
+        int i = work->next < work->num_scores ? work->next++ : -1;
+        pthread_mutex_unlock(&work->lock);
+        if (i == -1) {
+            break;
+        }
+        measure_center(work->csr, &self->search, &work->scores[i]);
+    }
+    return NULL;
+}
+
+/*
+ * compare_centers(a, b) -- Orders center scores for qsort: more actors
+ * reached first, then smaller mean distance, then by actor id.
+ */
+static int compare_centers(const void *a, const void *b) {
+    const struct CenterScore *x = a;
+    const struct CenterScore *y = b;
+    if (x->reached != y->reached) {
+        return x->reached > y->reached ? -1 : 1;
+    }
+    if (x->mean_distance != y->mean_distance) {
+        return x->mean_distance < y->mean_distance ? -1 : 1;
+    }
+    return x->actor - y->actor;
+}
+
+/*
+ * rank_centers(csr, k, num_threads) -- Measures k actors drawn at random
+ * (all of them if there are no more than k) on num_threads threads, and
+ * prints them from most to least central. Returns how many actors the
+ * searches visited, for --stats.
+ */
+long rank_centers(struct CsrGraph *csr, int k, int num_threads) {
+    int n = csr->num_actors;
+    if (k > n) {
+        k = n;
+    }
+
+    // The first k entries of a partial shuffle of all actor ids
+    int *ids = malloc(sizeof(int) * (n > 0 ? n : 1));
+    struct CenterScore *scores = malloc(sizeof(struct CenterScore) * (k > 0 ? k : 1));
+    struct CenterThread *threads = calloc(num_threads, sizeof(struct CenterThread));
+    if (!ids || !scores || !threads) {
+        fprintf(stderr, "Memory allocation failed for center ranking.\n");
+        exit(1);
+    }
+    for (int i = 0; i < n; i++) {
+        ids[i] = i;
+    }
+    srand(CENTER_SEED);
+    for (int i = 0; i < k; i++) {
+        int j = i + rand() % (n - i);
+        int tmp = ids[i];
+        ids[i] = ids[j];
+        ids[j] = tmp;
+        scores[i].actor = ids[i];
+    }
+    free(ids);
+
+    struct CenterWork work;
+    work.csr = csr;
+    work.scores = scores;
+    work.num_scores = k;
+    work.next = 0;
+    pthread_mutex_init(&work.lock, NULL);
+    for (int i = 0; i < num_threads; i++) {
+        threads[i].work = &work;
+        init_csr_search(csr, &threads[i].search);
+        if (pthread_create(&threads[i].thread, NULL, center_thread, &threads[i]) != 0) {
+            fprintf(stderr, "Error: Cannot start center thread.\n");
+            exit(1);
+        }
+    }
+
+    long visited = 0;
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(threads[i].thread, NULL);
+        visited += threads[i].search.visited;
+        free_csr_search(&threads[i].search);
+    }
+    pthread_mutex_destroy(&work.lock);
+    free(threads);
+
+    qsort(scores, k, sizeof(struct CenterScore), compare_centers);
+    for (int i = 0; i < k; i++) {
+        printf("%d. %s: mean distance %.3f to %d actors\n", i + 1, csr->strings + csr->actor_names[scores[i].actor],
+                scores[i].mean_distance, scores[i].reached);
+    }
+    free(scores);
+    return visited;
+}
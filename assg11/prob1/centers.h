@@ -0,0 +1,44 @@
+#ifndef CENTERS_H
+#define CENTERS_H
+
+#include <pthread.h>
+#include "csr.h"
+
+// Seed of the sample of actors --rank-centers measures, so runs agree
+#define CENTER_SEED 352
+
+/*
+ * CenterScore is how close one sampled actor is to the rest of the graph.
+ */
+struct CenterScore {
+    int actor;
+    int reached;            // Other actors with a path to this one
+    double mean_distance;   // Mean score of those actors with this one as the center
+};
+
+/*
+ * CenterWork is the sample of actors being measured, shared by the
+ * threads of rank_centers. Each thread searches with a CsrSearch of its
+ * own.
+ */
+struct CenterWork {
+    struct CsrGraph *csr;
+    struct CenterScore *scores;
+    int num_scores;
+    pthread_mutex_t lock;
+    int next;               // The next actor a thread measures, guarded by lock
+};
+
+/*
+ * CenterThread is one thread of rank_centers and the search state it owns.
+ */
+struct CenterThread {
+    struct CenterWork *work;
+    pthread_t thread;
+    struct CsrSearch search;
+};
+
+// Function prototypes
+long rank_centers(struct CsrGraph *csr, int k, int num_threads);
+
+#endif
@@ -0,0 +1,523 @@
+/*
+ * File: csr.c
+ * Author: Andy Siegel
+ * Purpose: Packs the linked actor-movie graph into compressed sparse row
+ * arrays with integer ids, and searches it there. Searching the linked
+ * structures chases an actor -> link -> movie -> link -> actor chain of
+ * separate mallocs for every edge; here the movies of an actor and the
+ * actors of a movie are each one run of ints, and which actors were seen
+ * is a bitset. The arrays keep the order of the linked lists, so a search
+ * visits actors in exactly the order bfs in graph.c does and finds the
+ * same paths.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include "csr.h"
+
+// csr_levels turns a step bottom-up once the frontier has more than
+// 1 / BOTTOM_UP_RATIO as many links as the vertices it could still reach
+#define BOTTOM_UP_RATIO 14
+
+/*
+ * csr_alloc(size) -- Allocates memory for the packed graph or a search.
+ * Exits on memory failure.
+ */
+static void* csr_alloc(size_t size) {
+    void *ptr = malloc(size > 0 ? size : 1);
+    if (!ptr) {
+        fprintf(stderr, "Memory allocation failed for packed graph.\n");
+        exit(1);
+    }
+    return ptr;
+}
+
+/*
+ * test_bit(bits, i) -- Returns whether bit i is set.
+ */
+static int test_bit(const uint64_t *bits, int i) {
+    return (bits[i >> 6] >> (i & 63)) & 1;
+}
+
+/*
+ * set_bit(bits, i) -- Sets bit i.
+ */
+static void set_bit(uint64_t *bits, int i) {
+    bits[i >> 6] |= (uint64_t)1 << (i & 63);
+}
+
+/*
+ * clear_side(seen, queue, len) -- Clears the bits the last search set,
+ * which are those of the actors in its queue, and empties the queue. Only
+ * queued actors have bits, so their whole words can be cleared.
+ */
+static void clear_side(uint64_t *seen, int *queue, int *len) {
+    for (int i = 0; i < *len; i++) {
+        seen[queue[i] >> 6] = 0;
+    }
+    *len = 0;
+}
+
+/*
+ * copy_name(csr, name, used) -- Copies a name to the end of the string
+ * table and returns its offset there.
+ */
+static int copy_name(struct CsrGraph *csr, const char *name, size_t *used) {
+    size_t len = strlen(name) + 1;
+    memcpy(csr->strings + *used, name, len);
+    *used += len;
+    return (int)(*used - len);
+}
+
+/*
+ * build_csr(actors, movies, csr) -- Numbers the actors and movies in list
+ * order and packs their names and links into arrays.
+ */
+void build_csr(struct Actor *actors, struct Movie *movies, struct CsrGraph *csr) {
+    int num_actors = 0;
+    int num_movies = 0;
+    long num_links = 0;
+    size_t strings_size = 0;
+    for (struct Actor *a = actors; a != NULL; a = a->next) {
+        a->id = num_actors++;
+        strings_size += strlen(a->name) + 1;
+    }
+    for (struct Movie *m = movies; m != NULL; m = m->next) {
+        m->id = num_movies++;
+        strings_size += strlen(m->name) + 1;
+        for (struct ActorMovieLink *al = m->actors; al != NULL; al = al->next) {
+            num_links++;
+        }
+    }
+    if (num_links > INT_MAX || strings_size > INT_MAX) {
+        fprintf(stderr, "Error: The movie file is too large for the packed graph.\n");
+        exit(1);
+    }
+
+    // Keep the table at most half full, like the actor index
+    int num_slots = 16;
+    while (num_slots < 2 * num_actors) {
+        num_slots *= 2;
+    }
+
+    csr->num_actors = num_actors;
+    csr->num_movies = num_movies;
+    csr->num_links = (int)num_links;
+    csr->strings = csr_alloc(strings_size);
+    csr->strings_size = (int)strings_size;
+    csr->actor_names = csr_alloc(sizeof(int) * num_actors);
+    csr->movie_names = csr_alloc(sizeof(int) * num_movies);
+    csr->actor_offsets = csr_alloc(sizeof(int) * (num_actors + 1));
+    csr->actor_movies = csr_alloc(sizeof(int) * num_links);
+    csr->movie_offsets = csr_alloc(sizeof(int) * (num_movies + 1));
+    csr->movie_actors = csr_alloc(sizeof(int) * num_links);
+    csr->actor_slots = csr_alloc(sizeof(int) * num_slots);
+    csr->num_slots = num_slots;
+    csr->mapping = NULL;
+    csr->mapping_size = 0;
+
+    size_t used = 0;
+    int edge = 0;
+    for (int i = 0; i < num_slots; i++) {
+        csr->actor_slots[i] = -1;
+    }
+    for (struct Actor *a = actors; a != NULL; a = a->next) {
+        csr->actor_names[a->id] = copy_name(csr, a->name, &used);
+        csr->actor_offsets[a->id] = edge;
+        for (struct MovieActorLink *ml = a->movies; ml != NULL; ml = ml->next) {
+            csr->actor_movies[edge++] = ml->movie->id;
+        }
+
+        // Names are unique, so the first empty slot is the actor's
+        size_t slot = a->hash & (num_slots - 1);
+        while (csr->actor_slots[slot] != -1) {
+            slot = (slot + 1) & (num_slots - 1);
+        }
+        csr->actor_slots[slot] = a->id;
+    }
+    csr->actor_offsets[num_actors] = edge;
+
+    edge = 0;
+    for (struct Movie *m = movies; m != NULL; m = m->next) {
+        csr->movie_names[m->id] = copy_name(csr, m->name, &used);
+        csr->movie_offsets[m->id] = edge;
+        for (struct ActorMovieLink *al = m->actors; al != NULL; al = al->next) {
+            csr->movie_actors[edge++] = al->actor->id;
+        }
+    }
+    csr->movie_offsets[num_movies] = edge;
+}
+
+/*
+ * csr_find_actor(csr, name) -- Looks an actor up by name. Returns its id,
+ * or -1 if there is no such actor.
+ */
+int csr_find_actor(struct CsrGraph *csr, const char *name) {
+    size_t mask = csr->num_slots - 1;
+    for (size_t slot = hash_name(name) & mask; ; slot = (slot + 1) & mask) {
+        int actor = csr->actor_slots[slot];
+        if (actor == -1 || strcmp(csr->strings + csr->actor_names[actor], name) == 0) {
+            return actor;
+        }
+    }
+}
+
+/*
+ * init_csr_search(csr, search) -- Allocates the state for searching csr.
+ */
+void init_csr_search(struct CsrGraph *csr, struct CsrSearch *search) {
+    int n = csr->num_actors;
+    size_t words = (size_t)(n + 63) / 64;
+    size_t movie_words = (size_t)(csr->num_movies + 63) / 64;
+    search->seen = calloc(words + 1, sizeof(uint64_t));
+    search->back_seen = calloc(words + 1, sizeof(uint64_t));
+    search->actor_frontier = calloc(words + 1, sizeof(uint64_t));
+    search->movie_seen = calloc(movie_words + 1, sizeof(uint64_t));
+    search->movie_frontier = calloc(movie_words + 1, sizeof(uint64_t));
+    if (!search->seen || !search->back_seen || !search->actor_frontier || !search->movie_seen ||
+            !search->movie_frontier) {
+        fprintf(stderr, "Memory allocation failed for packed graph.\n");
+        exit(1);
+    }
+    search->level = csr_alloc(sizeof(int) * n);
+    search->prev_actor = csr_alloc(sizeof(int) * n);
+    search->prev_movie = csr_alloc(sizeof(int) * n);
+    search->queue = csr_alloc(sizeof(int) * n);
+    search->back_level = csr_alloc(sizeof(int) * n);
+    search->back_queue = csr_alloc(sizeof(int) * n);
+    search->movie_queue = csr_alloc(sizeof(int) * csr->num_movies);
+    search->queue_len = 0;
+    search->back_queue_len = 0;
+    search->movie_queue_len = 0;
+    search->visited = 0;
+    search->steps = 0;
+    search->bottom_up_steps = 0;
+}
+
+/*
+ * csr_level(search, actor) -- Returns the level the last search from the
+ * start gave an actor, or -1 if it did not reach the actor.
+ */
+int csr_level(struct CsrSearch *search, int actor) {
+    return test_bit(search->seen, actor) ? search->level[actor] : -1;
+}
+
+/*
+ * visit(search, actor, level, prev_actor, prev_movie) -- Marks an actor seen
+ * by the search from the start and queues it.
+ */
+static void visit(struct CsrSearch *search, int actor, int level, int prev_actor, int prev_movie) {
+    set_bit(search->seen, actor);
+    search->level[actor] = level;
+    search->prev_actor[actor] = prev_actor;
+    search->prev_movie[actor] = prev_movie;
+    search->queue[search->queue_len++] = actor;
+    search->visited++;
+}
+
+/*
+ * csr_bfs(csr, search, start, end) -- Performs a Breadth-First Search from
+ * start until end is dequeued, like bfs in graph.c. With end -1 it searches
+ * everything reachable. Returns the level of end, or -1 if it was not found.
+ */
+int csr_bfs(struct CsrGraph *csr, struct CsrSearch *search, int start, int end) {
+    clear_side(search->seen, search->queue, &search->queue_len);
+    visit(search, start, 0, -1, -1);
+    if (start == end) return 0;
+
+    for (int head = 0; head < search->queue_len; head++) {
+        int current = search->queue[head];
+        if (current == end) {
+            return search->level[current];
+        }
+
+        // Iterate through movies of the current actor, then their co-stars
+        for (int i = csr->actor_offsets[current]; i < csr->actor_offsets[current + 1]; i++) {
+            int movie = csr->actor_movies[i];
+            for (int j = csr->movie_offsets[movie]; j < csr->movie_offsets[movie + 1]; j++) {
+                int costar = csr->movie_actors[j];
+                if (!test_bit(search->seen, costar)) {
+                    visit(search, costar, search->level[current] + 1, current, movie);
+                }
+            }
+        }
+    }
+    return -1;
+}
+
+/*
+ * bottom_up(offsets, targets, count, seen, frontier, queue, len) -- Finds
+ * the vertices of one side of the graph that are not in seen but are
+ * linked to a vertex in frontier, a bitset of the other side. Each vertex
+ * stops looking at the first such link, and words of seen with every bit
+ * set are skipped whole. The vertices found are marked seen and appended
+ * to queue after its first len entries. Returns the new length.
+ */
+static int bottom_up(const int *offsets, const int *targets, int count, uint64_t *seen, const uint64_t *frontier,
+        int *queue, int len) {
+    size_t words = (size_t)(count + 63) / 64;
+    for (size_t w = 0; w < words; w++) {
+        uint64_t unseen = ~seen[w];
+        while (unseen != 0) {
+            int v = (int)(w * 64) + __builtin_ctzll(unseen);
+            unseen &= unseen - 1;
+            if (v >= count) {
+                break;
+            }
+            for (int e = offsets[v]; e < offsets[v + 1]; e++) {
+                if (test_bit(frontier, targets[e])) {
+                    set_bit(seen, v);
+                    queue[len++] = v;
+                    break;
+                }
+            }
+        }
+    }
+    return len;
+}
+
+/*
+ * link_count(offsets, items, begin, end) -- Returns how many links the
+ * vertices items[begin] up to items[end - 1] have.
+ */
+static long link_count(const int *offsets, const int *items, int begin, int end) {
+    long count = 0;
+    for (int i = begin; i < end; i++) {
+        count += offsets[items[i] + 1] - offsets[items[i]];
+    }
+    return count;
+}
+
+/*
+ * csr_levels(csr, search, start) -- Searches everything reachable from
+ * start, like csr_bfs with end -1, but only finds levels: predecessors are
+ * not recorded, so the path cannot be printed. Returns the deepest level.
+ *
+ * Each level is two steps, from the frontier actors to the movies they
+ * were in and from those movies to their actors. A step runs top-down,
+ * following the links of the frontier, until the frontier has too many
+ * links compared with the vertices not seen yet (BOTTOM_UP_RATIO). Then it
+ * runs bottom-up instead: every vertex not seen yet looks for a link into
+ * the frontier and stops at the first one. In a small-world graph a few
+ * middle levels hold nearly every actor, and those steps get much cheaper.
+ */
+int csr_levels(struct CsrGraph *csr, struct CsrSearch *search, int start) {
+    int num_movies = csr->num_movies;
+    uint64_t *movie_seen = search->movie_seen;
+    uint64_t *movie_frontier = search->movie_frontier;
+    uint64_t *actor_frontier = search->actor_frontier;
+    int *movie_queue = search->movie_queue;
+
+    clear_side(search->seen, search->queue, &search->queue_len);
+    clear_side(movie_seen, movie_queue, &search->movie_queue_len);
+    visit(search, start, 0, -1, -1);
+
+    // Links of the actors and movies not seen yet
+    long actor_links_left = csr->num_links - (csr->actor_offsets[start + 1] - csr->actor_offsets[start]);
+    long movie_links_left = csr->num_links;
+
+    int level = 0;
+    int begin = 0;
+    int movie_len = 0;
+    while (begin < search->queue_len) {
+        int end = search->queue_len;
+        int movie_begin = movie_len;
+
+        // Actors to movies
+        search->steps++;
+        if (link_count(csr->actor_offsets, search->queue, begin, end) * BOTTOM_UP_RATIO > movie_links_left) {
+            search->bottom_up_steps++;
+            for (int i = begin; i < end; i++) {
+                set_bit(actor_frontier, search->queue[i]);
+            }
+            movie_len = bottom_up(csr->movie_offsets, csr->movie_actors, num_movies, movie_seen, actor_frontier,
+                    movie_queue, movie_len);
+            for (int i = begin; i < end; i++) {
+                actor_frontier[search->queue[i] >> 6] = 0;
+            }
+        } else {
+            for (int i = begin; i < end; i++) {
+                int actor = search->queue[i];
+                for (int j = csr->actor_offsets[actor]; j < csr->actor_offsets[actor + 1]; j++) {
+                    int movie = csr->actor_movies[j];
+                    if (!test_bit(movie_seen, movie)) {
+                        set_bit(movie_seen, movie);
+                        movie_queue[movie_len++] = movie;
+                    }
+                }
+            }
+        }
+        long movie_links = link_count(csr->movie_offsets, movie_queue, movie_begin, movie_len);
+        movie_links_left -= movie_links;
+
+        // Movies to actors
+        search->steps++;
+        if (movie_links * BOTTOM_UP_RATIO > actor_links_left) {
+            search->bottom_up_steps++;
+            for (int i = movie_begin; i < movie_len; i++) {
+                set_bit(movie_frontier, movie_queue[i]);
+            }
+            search->queue_len = bottom_up(csr->actor_offsets, csr->actor_movies, csr->num_actors, search->seen,
+                    movie_frontier, search->queue, search->queue_len);
+            for (int i = end; i < search->queue_len; i++) {
+                search->level[search->queue[i]] = level + 1;
+                search->prev_actor[search->queue[i]] = -1;
+                search->prev_movie[search->queue[i]] = -1;
+            }
+            search->visited += search->queue_len - end;
+            for (int i = movie_begin; i < movie_len; i++) {
+                movie_frontier[movie_queue[i] >> 6] = 0;
+            }
+        } else {
+            for (int i = movie_begin; i < movie_len; i++) {
+                int movie = movie_queue[i];
+                for (int j = csr->movie_offsets[movie]; j < csr->movie_offsets[movie + 1]; j++) {
+                    int costar = csr->movie_actors[j];
+                    if (!test_bit(search->seen, costar)) {
+                        visit(search, costar, level + 1, -1, -1);
+                    }
+                }
+            }
+        }
+        actor_links_left -= link_count(csr->actor_offsets, search->queue, end, search->queue_len);
+
+        begin = end;
+        if (begin < search->queue_len) {
+            level++;
+        }
+    }
+
+    search->movie_queue_len = movie_len;
+    return level;
+}
+
+/*
+ * expand_level(csr, seen, level, queue, begin, len, other_seen, other_level,
+ * visited) -- Grows one side of a bidirectional search by a level: the
+ * frontier is queue[*begin] up to queue[*len - 1]. Returns the shortest
+ * distance through an actor the other side has seen, or -1 if they did not
+ * meet.
+ */
+static int expand_level(struct CsrGraph *csr, uint64_t *seen, int *level, int *queue, int *begin, int *len,
+        uint64_t *other_seen, int *other_level, long *visited) {
+    int best = -1;
+    int end = *len;
+    for (int i = *begin; i < end; i++) {
+        int current = queue[i];
+        for (int j = csr->actor_offsets[current]; j < csr->actor_offsets[current + 1]; j++) {
+            int movie = csr->actor_movies[j];
+            for (int k = csr->movie_offsets[movie]; k < csr->movie_offsets[movie + 1]; k++) {
+                int costar = csr->movie_actors[k];
+                if (test_bit(seen, costar)) {
+                    continue;
+                }
+                set_bit(seen, costar);
+                level[costar] = level[current] + 1;
+                queue[(*len)++] = costar;
+                (*visited)++;
+
+                // Finish the level anyway: a later actor in it may meet the
+                // other side closer to its start
+                if (test_bit(other_seen, costar)) {
+                    int distance = level[costar] + other_level[costar];
+                    if (best < 0 || distance < best) {
+                        best = distance;
+                    }
+                }
+            }
+        }
+    }
+    *begin = end;
+    return best;
+}
+
+/*
+ * csr_bidirectional_bfs(csr, search, start, end) -- Finds the length of the
+ * shortest path between two actors by searching from both ends at once,
+ * always growing the smaller frontier by one level. Returns -1 if there is
+ * no path. Predecessors are not recorded, so the path cannot be printed.
+ */
+int csr_bidirectional_bfs(struct CsrGraph *csr, struct CsrSearch *search, int start, int end) {
+    if (start == end) return 0;
+
+    clear_side(search->seen, search->queue, &search->queue_len);
+    clear_side(search->back_seen, search->back_queue, &search->back_queue_len);
+    set_bit(search->seen, start);
+    search->level[start] = 0;
+    search->queue[search->queue_len++] = start;
+    set_bit(search->back_seen, end);
+    search->back_level[end] = 0;
+    search->back_queue[search->back_queue_len++] = end;
+    search->visited += 2;
+
+    int begin = 0;
+    int back_begin = 0;
+    while (begin < search->queue_len && back_begin < search->back_queue_len) {
+        int distance;
+        // The smaller frontier has the fewest co-stars to look at
+        if (search->queue_len - begin <= search->back_queue_len - back_begin) {
+            distance = expand_level(csr, search->seen, search->level, search->queue, &begin,
+                    &search->queue_len, search->back_seen, search->back_level, &search->visited);
+        } else {
+            distance = expand_level(csr, search->back_seen, search->back_level, search->back_queue,
+                    &back_begin, &search->back_queue_len, search->seen, search->level, &search->visited);
+        }
+        if (distance >= 0) {
+            return distance;
+        }
+    }
+    return -1;
+}
+
+/*
+ * csr_print_path(csr, search, actor, out) -- Prints the path from an actor
+ * the last csr_bfs reached back to where it started to out, in the same
+ * format as print_path.
+ */
+void csr_print_path(struct CsrGraph *csr, struct CsrSearch *search, int actor, FILE *out) {
+    fprintf(out, "%s\n", csr->strings + csr->actor_names[actor]);
+    for (int current = actor; search->prev_actor[current] != -1; current = search->prev_actor[current]) {
+        fprintf(out, "was in %s with\n", csr->strings + csr->movie_names[search->prev_movie[current]]);
+        fprintf(out, "%s\n", csr->strings + csr->actor_names[search->prev_actor[current]]);
+    }
+}
+
+/*
+ * free_csr_search(search) -- Frees the state of a search.
+ */
+void free_csr_search(struct CsrSearch *search) {
+    free(search->seen);
+    free(search->level);
+    free(search->prev_actor);
+    free(search->prev_movie);
+    free(search->queue);
+    free(search->back_seen);
+    free(search->back_level);
+    free(search->back_queue);
+    free(search->movie_seen);
+    free(search->movie_queue);
+    free(search->actor_frontier);
+    free(search->movie_frontier);
+}
+
+/*
+ * free_csr(csr) -- Frees the arrays of a packed graph, or unmaps the index
+ * file they were loaded from.
+ */
+void free_csr(struct CsrGraph *csr) {
+    if (csr->mapping != NULL) {
+        munmap(csr->mapping, csr->mapping_size);
+        return;
+    }
+    free(csr->strings);
+    free(csr->actor_names);
+    free(csr->movie_names);
+    free(csr->actor_offsets);
+    free(csr->actor_movies);
+    free(csr->movie_offsets);
+    free(csr->movie_actors);
+    free(csr->actor_slots);
+}
@@ -0,0 +1,81 @@
+#ifndef CSR_H
+#define CSR_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "graph.h"
+
+/*
+ * CsrGraph is the actor-movie graph packed into arrays once the movie file
+ * is read. Actors and movies are numbered from 0. The movies of actor a
+ * are actor_movies[actor_offsets[a]] up to actor_movies[actor_offsets[a + 1] - 1],
+ * and the actors of a movie are found the same way, in the same order as
+ * the linked lists they were packed from. Nothing in it is a pointer into
+ * other memory, so it can be written to an index file and mapped back in
+ * as it is (snapshot.c).
+ */
+struct CsrGraph {
+    int num_actors;
+    int num_movies;
+    int num_links;
+    char *strings;          // Every name, each ending in '\0'
+    int strings_size;
+    int *actor_names;       // Offsets of the names in strings
+    int *movie_names;
+    int *actor_offsets;
+    int *actor_movies;
+    int *movie_offsets;
+    int *movie_actors;
+    int *actor_slots;       // Open-addressing table of actor ids by name, -1 if empty
+    int num_slots;          // Always a power of two
+
+    void *mapping;          // The index file, if the arrays point into it
+    size_t mapping_size;
+};
+
+/*
+ * CsrSearch is the state of one search over a CsrGraph, indexed by actor
+ * id. An actor's level and predecessor are only valid while its bit is set
+ * in the seen bitset. Each search clears the bits the last one set.
+ * Nothing in it is shared, so threads can each search with their own.
+ */
+struct CsrSearch {
+    uint64_t *seen;
+    int *level;
+    int *prev_actor;        // -1 for the start of the search
+    int *prev_movie;
+    int *queue;             // Every actor seen, in the order it was seen
+    int queue_len;
+
+    // The second side of a bidirectional search
+    uint64_t *back_seen;
+    int *back_level;
+    int *back_queue;
+    int back_queue_len;
+
+    // The movies a csr_levels search has seen, and the frontiers of its
+    // bottom-up steps
+    uint64_t *movie_seen;
+    int *movie_queue;
+    int movie_queue_len;
+    uint64_t *actor_frontier;
+    uint64_t *movie_frontier;
+
+    long visited;           // Actors seen by all searches so far, for --stats
+    long steps;             // Steps of csr_levels searches, for --stats
+    long bottom_up_steps;   // How many of them went bottom-up
+};
+
+// Function prototypes
+void build_csr(struct Actor *actors, struct Movie *movies, struct CsrGraph *csr);
+int csr_find_actor(struct CsrGraph *csr, const char *name);
+void init_csr_search(struct CsrGraph *csr, struct CsrSearch *search);
+int csr_level(struct CsrSearch *search, int actor);
+int csr_bfs(struct CsrGraph *csr, struct CsrSearch *search, int start, int end);
+int csr_levels(struct CsrGraph *csr, struct CsrSearch *search, int start);
+int csr_bidirectional_bfs(struct CsrGraph *csr, struct CsrSearch *search, int start, int end);
+void csr_print_path(struct CsrGraph *csr, struct CsrSearch *search, int actor, FILE *out);
+void free_csr_search(struct CsrSearch *search);
+void free_csr(struct CsrGraph *csr);
+
+#endif
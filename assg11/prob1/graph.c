@@ -0,0 +1,456 @@
+/*
+ * File: graph.c
+ * Author: Andy Siegel
+ * Purpose: Builds the graph of actors and movies out of linked structures
+ * and searches it. Actors are found by name through a hash table, both
+ * while the movie file is read and for queries, and all names are copied
+ * into one string pool instead of being allocated one by one.
+ *
+ * bfs searches outward from Kevin Bacon and leaves each actor's level and
+ * predecessor behind, which is what print_path walks. bidirectional_bfs
+ * grows the smaller of two frontiers, one from each end, until they meet,
+ * and visits far fewer actors, but only finds the length of the path.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "graph.h"
+
+// Actors visited by all searches so far, for --stats
+long actors_visited = 0;
+
+/*
+ * intern_string(pool, str) -- Copies a string into the pool.
+ * @return The copy, which lives until free_pool. Exits on memory failure.
+ */
+char* intern_string(struct StringPool *pool, const char *str) {
+    size_t len = strlen(str) + 1;
+    struct StringBlock *block = pool->blocks;
+    if (block == NULL || block->size - block->used < len) {
+        size_t size = len > STRING_BLOCK_SIZE ? len : STRING_BLOCK_SIZE;
+        block = malloc(sizeof(struct StringBlock) + size);
+        if (!block) {
+            fprintf(stderr, "Memory allocation failed for string pool.\n");
+            exit(1);
+        }
+        block->next = pool->blocks;
+        block->used = 0;
+        block->size = size;
+        pool->blocks = block;
+    }
+    char *copy = block->data + block->used;
+    memcpy(copy, str, len);
+    block->used += len;
+    return copy;
+}
+
+/*
+ * free_pool(pool) -- Frees every string in the pool.
+ */
+void free_pool(struct StringPool *pool) {
+    struct StringBlock *block = pool->blocks;
+    while (block != NULL) {
+        struct StringBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    pool->blocks = NULL;
+}
+
+/*
+ * hash_name(name) -- Returns the 64-bit FNV-1a hash of a name.
+ */
+unsigned long hash_name(const char *name) {
+    unsigned long hash = 14695981039346656037UL;
+    for (const unsigned char *p = (const unsigned char*)name; *p != '\0'; p++) {
+        hash ^= *p;
+        hash *= 1099511628211UL;
+    }
+    return hash;
+}
+
+/*
+ * init_index(index) -- Sets up an empty actor index.
+ */
+void init_index(struct ActorIndex *index) {
+    index->capacity = 1024;
+    index->count = 0;
+    index->slots = calloc(index->capacity, sizeof(struct Actor*));
+    if (!index->slots) {
+        fprintf(stderr, "Memory allocation failed for actor index.\n");
+        exit(1);
+    }
+}
+
+/*
+ * find_slot(slots, capacity, name, hash) -- Returns the slot holding the
+ * actor called name, or the empty slot where it belongs.
+ */
+static size_t find_slot(struct Actor **slots, size_t capacity, const char *name, unsigned long hash) {
+    size_t mask = capacity - 1;
+    size_t i = hash & mask;
+    while (slots[i] != NULL && (slots[i]->hash != hash || strcmp(slots[i]->name, name) != 0)) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+/*
+ * grow_index(index) -- Doubles the index and moves every actor into it.
+ */
+static void grow_index(struct ActorIndex *index) {
+    size_t new_capacity = index->capacity * 2;
+    struct Actor **new_slots = calloc(new_capacity, sizeof(struct Actor*));
+    if (!new_slots) {
+        fprintf(stderr, "Memory allocation failed for actor index.\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < index->capacity; i++) {
+        struct Actor *actor = index->slots[i];
+        if (actor != NULL) {
+            new_slots[find_slot(new_slots, new_capacity, actor->name, actor->hash)] = actor;
+        }
+    }
+    free(index->slots);
+    index->slots = new_slots;
+    index->capacity = new_capacity;
+}
+
+/*
+ * find_actor(index, name) -- Looks an actor up by name in the index.
+ */
+struct Actor* find_actor(struct ActorIndex *index, const char *name) {
+    return index->slots[find_slot(index->slots, index->capacity, name, hash_name(name))];
+}
+
+/*
+ * add_actor(head_ptr, index, pool, name) -- Creates and adds a new actor to
+ * a list and the index if they don't already exist.
+ * @param head_ptr A pointer to the head of the actor list.
+ * @param index The index of all actors by name.
+ * @param pool The string pool the name is copied into.
+ * @param name The name of the actor to add.
+ * @return A pointer to the new or existing Actor struct. Exits on memory failure.
+ */
+struct Actor* add_actor(struct Actor **head_ptr, struct ActorIndex *index, struct StringPool *pool,
+        const char *name) {
+    unsigned long hash = hash_name(name);
+    size_t slot = find_slot(index->slots, index->capacity, name, hash);
+    struct Actor *actor = index->slots[slot];
+    if (actor == NULL) {
+        actor = malloc(sizeof(struct Actor));
+        if (!actor) {
+            fprintf(stderr, "Memory allocation failed for actor.\n");
+            exit(1);
+        }
+        actor->name = intern_string(pool, name);
+        actor->hash = hash;
+        actor->movies = NULL;
+        actor->visited = 0;
+        actor->level = -1;
+        actor->prev_actor_in_path = NULL;
+        actor->prev_movie_in_path = NULL;
+        actor->forward_stamp = 0;
+        actor->backward_stamp = 0;
+        actor->id = -1;
+        actor->next = *head_ptr;
+        *head_ptr = actor;
+
+        // Keep the load factor under 3/4 so probe sequences stay short
+        index->slots[slot] = actor;
+        index->count++;
+        if (index->count * 4 > index->capacity * 3) {
+            grow_index(index);
+        }
+    }
+    return actor;
+}
+
+/*
+ * add_movie(head_ptr, pool, name) -- Creates and adds a new movie to a list.
+ * @param head_ptr A pointer to the head of the movie list.
+ * @param pool The string pool the name is copied into.
+ * @param name The name of the movie to add.
+ * @return A pointer to the new Movie struct. Exits on memory failure.
+ */
+struct Movie* add_movie(struct Movie **head_ptr, struct StringPool *pool, const char *name) {
+    struct Movie *movie = malloc(sizeof(struct Movie));
+    if (!movie) {
+        fprintf(stderr, "Memory allocation failed for movie.\n");
+        exit(1);
+    }
+    movie->name = intern_string(pool, name);
+    movie->actors = NULL;
+    movie->id = -1;
+    movie->next = *head_ptr;
+    *head_ptr = movie;
+    return movie;
+}
+
+/*
+ * link_actor_and_movie(actor, movie) -- Creates a bidirectional link
+ * between an actor and a movie.
+ */
+void link_actor_and_movie(struct Actor *actor, struct Movie *movie) {
+    // Add movie to actor's list
+    struct MovieActorLink *new_movie_link = malloc(sizeof(struct MovieActorLink));
+    if (!new_movie_link) exit(1);
+    new_movie_link->movie = movie;
+    new_movie_link->next = actor->movies;
+    actor->movies = new_movie_link;
+
+    // Add actor to movie's list
+    struct ActorMovieLink *new_actor_link = malloc(sizeof(struct ActorMovieLink));
+    if (!new_actor_link) exit(1);
+    new_actor_link->actor = actor;
+    new_actor_link->next = movie->actors;
+    movie->actors = new_actor_link;
+}
+
+/*
+ * create_queue(capacity) -- Creates and initializes an empty queue with
+ * room for capacity actors.
+ */
+static struct Queue* create_queue(int capacity) {
+    struct Queue *q = malloc(sizeof(struct Queue));
+    struct Actor **items = malloc(sizeof(struct Actor*) * (capacity > 0 ? capacity : 1));
+    if (!q || !items) {
+        fprintf(stderr, "Memory allocation failed for queue.\n");
+        exit(1);
+    }
+    q->items = items;
+    q->capacity = capacity > 0 ? capacity : 1;
+    q->front = 0;
+    q->count = 0;
+    return q;
+}
+
+/*
+ * enqueue(q, actor) -- Adds an actor to the rear of the queue.
+ */
+static void enqueue(struct Queue *q, struct Actor *actor) {
+    q->items[(q->front + q->count) % q->capacity] = actor;
+    q->count++;
+}
+
+/*
+ * dequeue(q) -- Removes an actor from the front of the queue. Returns NULL
+ * if it is empty.
+ */
+static struct Actor* dequeue(struct Queue *q) {
+    if (q->count == 0) return NULL;
+    struct Actor *actor = q->items[q->front];
+    q->front = (q->front + 1) % q->capacity;
+    q->count--;
+    return actor;
+}
+
+/*
+ * free_queue(q) -- Frees all memory associated with a queue.
+ */
+static void free_queue(struct Queue* q) {
+    free(q->items);
+    free(q);
+}
+
+/*
+ * bfs(start_actor, end_actor_name) -- Performs a Breadth-First Search to find the
+ * shortest path from a starting actor to a target actor. With a NULL target
+ * it searches everything reachable, leaving every actor's level and
+ * predecessor set, and returns -1.
+ */
+int bfs(struct Actor *all_actors, struct Actor *start_actor, struct Actor *end_actor) {
+    if (start_actor == end_actor) return 0;
+
+    // Reset BFS state for all actors, counting them for the queue
+    int num_actors = 0;
+    for (struct Actor *a = all_actors; a != NULL; a = a->next) {
+        a->visited = 0;
+        a->level = -1;
+        a->prev_actor_in_path = NULL;
+        a->prev_movie_in_path = NULL;
+        num_actors++;
+    }
+
+    struct Queue *q = create_queue(num_actors);
+    start_actor->visited = 1;
+    start_actor->level = 0;
+    enqueue(q, start_actor);
+    actors_visited++;
+
+    while (q->count > 0) {
+        struct Actor *current_actor = dequeue(q);
+        if (current_actor == end_actor) {
+            int level = current_actor->level;
+            free_queue(q);
+            return level;
+        }
+
+        // Iterate through movies of the current actor
+        for (struct MovieActorLink *ml = current_actor->movies; ml != NULL; ml = ml->next) {
+            struct Movie *current_movie = ml->movie;
+            // Iterate through co-stars in that movie
+            for (struct ActorMovieLink *al = current_movie->actors; al != NULL; al = al->next) {
+                struct Actor *costar = al->actor;
+                if (!costar->visited) {
+                    costar->visited = 1;
+                    costar->level = current_actor->level + 1;
+                    costar->prev_actor_in_path = current_actor;
+                    costar->prev_movie_in_path = current_movie;
+                    enqueue(q, costar);
+                    actors_visited++;
+                }
+            }
+        }
+    }
+    free_queue(q);
+    return -1; // No path found
+}
+
+/*
+ * append_actor(arr, actor) -- Adds an actor to the end of an array, growing
+ * it as needed.
+ */
+static void append_actor(struct ActorArray *arr, struct Actor *actor) {
+    if (arr->count == arr->capacity) {
+        int new_capacity = arr->capacity == 0 ? 64 : arr->capacity * 2;
+        struct Actor **new_items = realloc(arr->items, sizeof(struct Actor*) * new_capacity);
+        if (!new_items) {
+            fprintf(stderr, "Memory allocation failed for search frontier.\n");
+            exit(1);
+        }
+        arr->items = new_items;
+        arr->capacity = new_capacity;
+    }
+    arr->items[arr->count++] = actor;
+}
+
+/*
+ * expand_frontier(frontier, next, forward, stamp) -- Visits every unvisited
+ * co-star of the actors in frontier from one side of the search, and
+ * collects them in next. Returns the shortest distance through an actor the
+ * other side has already visited, or -1 if the two sides did not meet.
+ */
+static int expand_frontier(struct ActorArray *frontier, struct ActorArray *next, int forward, int stamp) {
+    int best = -1;
+    next->count = 0;
+    for (int i = 0; i < frontier->count; i++) {
+        struct Actor *current_actor = frontier->items[i];
+        int level = forward ? current_actor->forward_level : current_actor->backward_level;
+        for (struct MovieActorLink *ml = current_actor->movies; ml != NULL; ml = ml->next) {
+            for (struct ActorMovieLink *al = ml->movie->actors; al != NULL; al = al->next) {
+                struct Actor *costar = al->actor;
+                int *seen = forward ? &costar->forward_stamp : &costar->backward_stamp;
+                if (*seen == stamp) {
+                    continue;
+                }
+                *seen = stamp;
+                if (forward) {
+                    costar->forward_level = level + 1;
+                } else {
+                    costar->backward_level = level + 1;
+                }
+                append_actor(next, costar);
+                actors_visited++;
+
+                // Finish the level anyway: a later actor in it may meet the
+                // other side closer to its start
+                int other_stamp = forward ? costar->backward_stamp : costar->forward_stamp;
+                if (other_stamp == stamp) {
+                    int distance = costar->forward_level + costar->backward_level;
+                    if (best < 0 || distance < best) {
+                        best = distance;
+                    }
+                }
+            }
+        }
+    }
+    return best;
+}
+
+/*
+ * bidirectional_bfs(start_actor, end_actor) -- Finds the length of the
+ * shortest path between two actors by searching from both ends at once,
+ * always growing the smaller frontier by one level. Returns -1 if there is
+ * no path.
+ */
+int bidirectional_bfs(struct Actor *start_actor, struct Actor *end_actor) {
+    static int stamp = 0;
+    if (start_actor == end_actor) return 0;
+
+    stamp++;
+    struct ActorArray forward = {NULL, 0, 0};
+    struct ActorArray backward = {NULL, 0, 0};
+    struct ActorArray next = {NULL, 0, 0};
+
+    start_actor->forward_stamp = stamp;
+    start_actor->forward_level = 0;
+    end_actor->backward_stamp = stamp;
+    end_actor->backward_level = 0;
+    append_actor(&forward, start_actor);
+    append_actor(&backward, end_actor);
+    actors_visited += 2;
+
+    int distance = -1;
+    while (distance < 0 && forward.count > 0 && backward.count > 0) {
+        // The smaller frontier has the fewest co-stars to look at
+        int grow_forward = forward.count <= backward.count;
+        struct ActorArray *frontier = grow_forward ? &forward : &backward;
+        distance = expand_frontier(frontier, &next, grow_forward, stamp);
+        struct ActorArray swap = *frontier;
+        *frontier = next;
+        next = swap;
+    }
+
+    free(forward.items);
+    free(backward.items);
+    free(next.items);
+    return distance;
+}
+
+/*
+ * print_path(actor) -- Prints the path from the queried actor back to Kevin Bacon.
+ */
+void print_path(struct Actor *actor) {
+    // The prev pointers lead from the queried actor to Kevin Bacon, the
+    // order the path is printed in, so it can be printed while following them
+    printf("%s\n", actor->name);
+    for (struct Actor *current = actor; current->prev_actor_in_path != NULL;
+            current = current->prev_actor_in_path) {
+        printf("was in %s with\n", current->prev_movie_in_path->name);
+        printf("%s\n", current->prev_actor_in_path->name);
+    }
+}
+
+/*
+ * free_graph(actors, movies) -- Frees all dynamically allocated memory for
+ * the entire graph, except the names, which are freed with the string pool.
+ */
+void free_graph(struct Actor *actors, struct Movie *movies) {
+    struct Actor *current_actor = actors;
+    while (current_actor != NULL) {
+        struct Actor *next_actor = current_actor->next;
+        struct MovieActorLink *current_movie_link = current_actor->movies;
+        while (current_movie_link != NULL) {
+            struct MovieActorLink *next_link = current_movie_link->next;
+            free(current_movie_link);
+            current_movie_link = next_link;
+        }
+        free(current_actor);
+        current_actor = next_actor;
+    }
+
+    struct Movie *current_movie = movies;
+    while (current_movie != NULL) {
+        struct Movie *next_movie = current_movie->next;
+        struct ActorMovieLink *current_actor_link = current_movie->actors;
+        while (current_actor_link != NULL) {
+            struct ActorMovieLink *next_link = current_actor_link->next;
+            free(current_actor_link);
+            current_actor_link = next_link;
+        }
+        free(current_movie);
+        current_movie = next_movie;
+    }
+}
@@ -0,0 +1,132 @@
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include <stddef.h>
+
+// Forward declarations for structs
+struct Actor;
+struct Movie;
+
+/*
+ * MovieActorLink is a node in a linked list connecting an actor to a movie
+ * they were in.
+ */
+struct MovieActorLink {
+    struct Movie *movie;
+    struct MovieActorLink *next;
+};
+
+/*
+ * Actor is a vertex in the graph, representing a person.
+ */
+struct Actor {
+    char *name;                   // Points into the string pool
+    unsigned long hash;           // Hash of the name, for the actor index
+    struct MovieActorLink *movies; // List of movies this actor was in
+    struct Actor *next;           // For the global list of all actors
+    int id;                       // Index in the packed graph (csr.c)
+
+    // BFS-related fields
+    int visited;
+    int level;
+    struct Actor *prev_actor_in_path;
+    struct Movie *prev_movie_in_path;
+
+    // Bidirectional search fields, only valid while a stamp matches the
+    // current search, so nothing has to be reset between queries
+    int forward_stamp;
+    int forward_level;
+    int backward_stamp;
+    int backward_level;
+};
+
+/*
+ * ActorMovieLink is a node in a linked list connecting a movie to an actor
+ * who appeared in it.
+ */
+struct ActorMovieLink {
+    struct Actor *actor;
+    struct ActorMovieLink *next;
+};
+
+/*
+ * Movie is an edge in the graph, representing a film.
+ */
+struct Movie {
+    char *name;                  // Points into the string pool
+    struct ActorMovieLink *actors; // List of actors in this movie
+    struct Movie *next;          // For the global list of all movies
+    int id;                      // Index in the packed graph (csr.c)
+};
+
+/*
+ * Queue represents a simple FIFO queue for the BFS algorithm. It is a ring
+ * buffer with room for every actor, since a search queues each actor at
+ * most once.
+ */
+struct Queue {
+    struct Actor **items;
+    int capacity;
+    int front;                    // Index of the next actor to dequeue
+    int count;
+};
+
+/*
+ * ActorArray is a growable array of actors, used for the frontiers of the
+ * bidirectional search.
+ */
+struct ActorArray {
+    struct Actor **items;
+    int count;
+    int capacity;
+};
+
+/*
+ * StringBlock is one chunk of the string pool. Names are copied into it
+ * back to back, and all of them are freed together with the graph.
+ */
+struct StringBlock {
+    struct StringBlock *next;
+    size_t used;
+    size_t size;
+    char data[];
+};
+
+/*
+ * StringPool holds every actor and movie name of the graph.
+ */
+struct StringPool {
+    struct StringBlock *blocks;
+};
+
+// Size of a string pool block; longer names get a block of their own
+#define STRING_BLOCK_SIZE 65536
+
+/*
+ * ActorIndex is an open-addressing hash table of all actors, keyed by name.
+ */
+struct ActorIndex {
+    struct Actor **slots;
+    size_t capacity;              // Always a power of two
+    size_t count;
+};
+
+// Actors visited by all searches so far, for --stats
+extern long actors_visited;
+
+// Function prototypes
+char* intern_string(struct StringPool *pool, const char *str);
+void free_pool(struct StringPool *pool);
+unsigned long hash_name(const char *name);
+void init_index(struct ActorIndex *index);
+struct Actor* find_actor(struct ActorIndex *index, const char *name);
+struct Actor* add_actor(struct Actor **head_ptr, struct ActorIndex *index, struct StringPool *pool,
+        const char *name);
+struct Movie* add_movie(struct Movie **head_ptr, struct StringPool *pool, const char *name);
+void link_actor_and_movie(struct Actor *actor, struct Movie *movie);
+int bfs(struct Actor *all_actors, struct Actor *start_actor, struct Actor *end_actor);
+int bidirectional_bfs(struct Actor *start_actor, struct Actor *end_actor);
+void print_path(struct Actor *actor);
+void free_graph(struct Actor *actors, struct Movie *movies);
+
+#endif
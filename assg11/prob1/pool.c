@@ -0,0 +1,196 @@
+/*
+ * File: pool.c
+ * Author: Andy Siegel
+ * Purpose: Answers queries on several threads at once (-t N). The packed
+ * graph is only read once it is built, and everything a search writes is
+ * in a CsrSearch, so each thread searches with its own. Queries are read in
+ * batches; the threads take the next unanswered query of a batch until none
+ * are left, and write what it prints into a buffer of its own. The batch is
+ * then printed in input order.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pool.h"
+
+/*
+ * score_with_csr(mode, l_option, csr, search, kevin_bacon, actor) -- Finds
+ * the score of an actor by searching the packed graph. Returns -1 for no
+ * path. Afterwards csr_print_path can print the path when l_option is set.
+ */
+int score_with_csr(enum SearchMode mode, int l_option, struct CsrGraph *csr, struct CsrSearch *search,
+        int kevin_bacon, int actor) {
+    if (mode == SEARCH_TREE) {
+        return csr_level(search, actor);
+    } else if (l_option || mode == SEARCH_FORWARD) {
+        return csr_bfs(csr, search, kevin_bacon, actor);
+    } else {
+        return csr_bidirectional_bfs(csr, search, kevin_bacon, actor);
+    }
+}
+
+/*
+ * answer_query(pool, search, query) -- Answers one query with a thread's
+ * search, writing what it prints into query->output.
+ */
+static void answer_query(struct QueryPool *pool, struct CsrSearch *search, struct Query *query) {
+    FILE *out = open_memstream(&query->output, &query->output_len);
+    if (!out) {
+        fprintf(stderr, "Memory allocation failed for query output.\n");
+        exit(1);
+    }
+
+    if (pool->kevin_bacon == -1) {
+        fprintf(out, "Score: No Bacon!\n");
+    } else {
+        // In tree mode every thread reads the one search made up front
+        if (pool->mode == SEARCH_TREE) {
+            search = pool->tree;
+        }
+        int score = score_with_csr(pool->mode, pool->l_option, pool->csr, search, pool->kevin_bacon,
+                query->actor);
+        if (score != -1) {
+            fprintf(out, "Score: %d\n", score);
+            if (pool->l_option) {
+                csr_print_path(pool->csr, search, query->actor, out);
+            }
+        } else {
+            fprintf(out, "Score: No Bacon!\n");
+        }
+    }
+
+    if (fclose(out) != 0) {
+        fprintf(stderr, "Memory allocation failed for query output.\n");
+        exit(1);
+    }
+}
+
+/*
+ * pool_thread(arg) -- The loop each thread of the pool runs: wait for a
+ * batch, answer queries from it until there are none left, and repeat
+ * until the pool stops.
+ */
+static void* pool_thread(void *arg) {
+    struct PoolThread *self = arg;
+    struct QueryPool *pool = self->pool;
+    int batch = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        while (!pool->stopping && pool->batch == batch) {
+            pthread_cond_wait(&pool->work_ready, &pool->lock);
+        }
+        if (pool->stopping) {
+            break;
+        }
+        batch = pool->batch;
+
+        while (pool->next_query < pool->num_queries) {
+            struct Query *query = &pool->queries[pool->next_query++];
+            pthread_mutex_unlock(&pool->lock);
+            if (query->actor != -1) {
+                answer_query(pool, &self->search, query);
+            }
+            pthread_mutex_lock(&pool->lock);
+            if (++pool->finished == pool->num_queries) {
+                pthread_cond_signal(&pool->work_done);
+            }
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/*
+ * start_pool(pool, num_threads, csr, mode, l_option, kevin_bacon, tree) --
+ * Starts num_threads threads answering queries about csr. In tree mode they
+ * share tree, the search from Kevin Bacon, and need no state of their own.
+ */
+void start_pool(struct QueryPool *pool, int num_threads, struct CsrGraph *csr, enum SearchMode mode,
+        int l_option, int kevin_bacon, struct CsrSearch *tree) {
+    pool->csr = csr;
+    pool->mode = mode;
+    pool->l_option = l_option;
+    pool->kevin_bacon = kevin_bacon;
+    pool->tree = tree;
+    pool->num_threads = num_threads;
+    pool->queries = NULL;
+    pool->num_queries = 0;
+    pool->next_query = 0;
+    pool->finished = 0;
+    pool->batch = 0;
+    pool->stopping = 0;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+
+    pool->threads = calloc(num_threads, sizeof(struct PoolThread));
+    if (!pool->threads) {
+        fprintf(stderr, "Memory allocation failed for query threads.\n");
+        exit(1);
+    }
+    for (int i = 0; i < num_threads; i++) {
+        struct PoolThread *thread = &pool->threads[i];
+        thread->pool = pool;
+        if (mode != SEARCH_TREE) {
+            init_csr_search(csr, &thread->search);
+        }
+        if (pthread_create(&thread->thread, NULL, pool_thread, thread) != 0) {
+            fprintf(stderr, "Error: Cannot start query thread.\n");
+            exit(1);
+        }
+    }
+}
+
+/*
+ * run_batch(pool, queries, num_queries) -- Answers a batch of queries on
+ * the pool's threads and returns once all of them are answered.
+ */
+void run_batch(struct QueryPool *pool, struct Query *queries, int num_queries) {
+    if (num_queries == 0) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->queries = queries;
+    pool->num_queries = num_queries;
+    pool->next_query = 0;
+    pool->finished = 0;
+    pool->batch++;
+    pthread_cond_broadcast(&pool->work_ready);
+    while (pool->finished < num_queries) {
+        pthread_cond_wait(&pool->work_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/*
+ * pool_visited(pool) -- Returns how many actors the pool's searches have
+ * visited, for --stats.
+ */
+long pool_visited(struct QueryPool *pool) {
+    long visited = 0;
+    for (int i = 0; i < pool->num_threads; i++) {
+        visited += pool->threads[i].search.visited;
+    }
+    return visited;
+}
+
+/*
+ * stop_pool(pool) -- Stops the pool's threads and frees their state.
+ */
+void stop_pool(struct QueryPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->num_threads; i++) {
+        pthread_join(pool->threads[i].thread, NULL);
+        free_csr_search(&pool->threads[i].search);
+    }
+    free(pool->threads);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_cond_destroy(&pool->work_done);
+}
@@ -0,0 +1,73 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <pthread.h>
+#include "csr.h"
+
+struct QueryPool;
+
+/*
+ * SearchMode selects how queries are answered (--search=).
+ */
+enum SearchMode {
+    SEARCH_BIDIRECTIONAL,   // A bidirectional search per query
+    SEARCH_FORWARD,         // A search from Kevin Bacon per query
+    SEARCH_TREE             // One search from Kevin Bacon for all queries
+};
+
+/*
+ * Query is one line of stdin in a batch. A thread fills in output with what
+ * the query prints, so the batch can be printed in input order afterwards.
+ */
+struct Query {
+    char *name;
+    int actor;              // -1 if the actor is not in the graph
+    char *output;           // "Score: ..." and, with -l, the path
+    size_t output_len;
+};
+
+/*
+ * PoolThread is one thread of a QueryPool and the search state it owns.
+ */
+struct PoolThread {
+    struct QueryPool *pool;
+    pthread_t thread;
+    struct CsrSearch search;
+};
+
+/*
+ * QueryPool is a set of threads answering batches of queries against the
+ * packed graph, which they only read.
+ */
+struct QueryPool {
+    struct CsrGraph *csr;
+    enum SearchMode mode;
+    int l_option;
+    int kevin_bacon;        // -1 if Kevin Bacon is not in the graph
+    struct CsrSearch *tree; // The search from Kevin Bacon, for SEARCH_TREE
+
+    int num_threads;
+    struct PoolThread *threads;
+
+    // Guarded by lock
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+    struct Query *queries;
+    int num_queries;
+    int next_query;         // The next query a thread takes
+    int finished;           // Queries of the batch answered so far
+    int batch;              // Counts batches, so threads notice a new one
+    int stopping;
+};
+
+// Function prototypes
+int score_with_csr(enum SearchMode mode, int l_option, struct CsrGraph *csr, struct CsrSearch *search,
+        int kevin_bacon, int actor);
+void start_pool(struct QueryPool *pool, int num_threads, struct CsrGraph *csr, enum SearchMode mode,
+        int l_option, int kevin_bacon, struct CsrSearch *tree);
+void run_batch(struct QueryPool *pool, struct Query *queries, int num_queries);
+long pool_visited(struct QueryPool *pool);
+void stop_pool(struct QueryPool *pool);
+
+#endif
@@ -0,0 +1,234 @@
+/*
+ * File: snapshot.c
+ * Author: Andy Siegel
+ * Purpose: Saves the packed graph to an index file (--build-index) and maps
+ * it back in. Reading the text movie file means parsing every line and
+ * hashing every name before the first query can be answered; an index file
+ * is the arrays of the packed graph exactly as they are in memory, so
+ * loading one is a single mmap. Pages of it are read in as searches first
+ * touch them, which suits short runs that only answer a few queries.
+ *
+ * Index files are written and read on the same kind of machine; the header
+ * records the byte order and layout version, and other files are refused.
+ * Before a mapped file is used, every offset and id in it is checked, so a
+ * damaged index is reported instead of crashing a search. That is one pass
+ * over the arrays, still far cheaper than parsing the movie file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "snapshot.h"
+
+// Arrays stored after the header
+#define SNAPSHOT_SECTIONS 8
+
+// Rounds a size up to a multiple of 8 bytes
+#define ALIGN8(n) (((n) + 7) & ~(size_t)7)
+
+/*
+ * section_sizes(header, sizes) -- Fills in the size in bytes of each array
+ * stored after the header, in the order they are stored.
+ */
+static void section_sizes(const struct SnapshotHeader *header, size_t sizes[SNAPSHOT_SECTIONS]) {
+    sizes[0] = header->strings_size;
+    sizes[1] = sizeof(int) * (size_t)header->num_actors;
+    sizes[2] = sizeof(int) * (size_t)header->num_movies;
+    sizes[3] = sizeof(int) * ((size_t)header->num_actors + 1);
+    sizes[4] = sizeof(int) * (size_t)header->num_links;
+    sizes[5] = sizeof(int) * ((size_t)header->num_movies + 1);
+    sizes[6] = sizeof(int) * (size_t)header->num_links;
+    sizes[7] = sizeof(int) * (size_t)header->num_slots;
+}
+
+/*
+ * write_snapshot(csr, filename) -- Writes the packed graph to an index
+ * file. The file is written under a temporary name and renamed, so a run
+ * reading the index at the same time never sees half of one. Returns 0 on
+ * success and 1 on failure.
+ */
+int write_snapshot(struct CsrGraph *csr, const char *filename) {
+    struct SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.byte_order = SNAPSHOT_BYTE_ORDER;
+    header.num_actors = csr->num_actors;
+    header.num_movies = csr->num_movies;
+    header.num_links = csr->num_links;
+    header.num_slots = csr->num_slots;
+    header.strings_size = csr->strings_size;
+
+    size_t sizes[SNAPSHOT_SECTIONS];
+    section_sizes(&header, sizes);
+    const void *sections[SNAPSHOT_SECTIONS] = {
+        csr->strings, csr->actor_names, csr->movie_names, csr->actor_offsets,
+        csr->actor_movies, csr->movie_offsets, csr->movie_actors, csr->actor_slots
+    };
+
+    char *tmp = malloc(strlen(filename) + sizeof(".tmp"));
+    if (!tmp) {
+        fprintf(stderr, "Memory allocation failed for index file name.\n");
+        exit(1);
+    }
+    sprintf(tmp, "%s.tmp", filename);
+
+    FILE *file = fopen(tmp, "wb");
+    if (!file) {
+        fprintf(stderr, "Error: Cannot write index file %s\n", filename);
+        free(tmp);
+        return 1;
+    }
+
+    static const char padding[8] = {0};
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (int i = 0; i < SNAPSHOT_SECTIONS && ok; i++) {
+        size_t pad = ALIGN8(sizes[i]) - sizes[i];
+        ok = fwrite(sections[i], 1, sizes[i], file) == sizes[i] && fwrite(padding, 1, pad, file) == pad;
+    }
+    if (fclose(file) != 0) {
+        ok = 0;
+    }
+    if (!ok || rename(tmp, filename) != 0) {
+        fprintf(stderr, "Error: Cannot write index file %s\n", filename);
+        unlink(tmp);
+        free(tmp);
+        return 1;
+    }
+    free(tmp);
+    return 0;
+}
+
+/*
+ * valid_offsets(offsets, count, total) -- Returns whether a CSR offset array
+ * of count + 1 entries starts at 0, never decreases and ends at total.
+ */
+static int valid_offsets(const int *offsets, int count, int total) {
+    if (offsets[0] != 0 || offsets[count] != total) {
+        return 0;
+    }
+    for (int i = 0; i < count; i++) {
+        if (offsets[i] > offsets[i + 1]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * valid_ids(ids, count, limit) -- Returns whether every one of count ids is
+ * at least 0 and below limit.
+ */
+static int valid_ids(const int *ids, int count, int limit) {
+    for (int i = 0; i < count; i++) {
+        if (ids[i] < 0 || ids[i] >= limit) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * valid_graph(csr) -- Returns whether a mapped packed graph can be searched
+ * safely: offsets in order, ids and name offsets in range, the string table
+ * ending in '\0', and an empty slot in the name table so lookups end.
+ */
+static int valid_graph(struct CsrGraph *csr) {
+    if (csr->strings_size > 0 && csr->strings[csr->strings_size - 1] != '\0') {
+        return 0;
+    }
+    if (!valid_offsets(csr->actor_offsets, csr->num_actors, csr->num_links) ||
+            !valid_offsets(csr->movie_offsets, csr->num_movies, csr->num_links) ||
+            !valid_ids(csr->actor_movies, csr->num_links, csr->num_movies) ||
+            !valid_ids(csr->movie_actors, csr->num_links, csr->num_actors) ||
+            !valid_ids(csr->actor_names, csr->num_actors, csr->strings_size) ||
+            !valid_ids(csr->movie_names, csr->num_movies, csr->strings_size)) {
+        return 0;
+    }
+    int empty_slots = 0;
+    for (int i = 0; i < csr->num_slots; i++) {
+        int actor = csr->actor_slots[i];
+        if (actor == -1) {
+            empty_slots++;
+        } else if (actor < 0 || actor >= csr->num_actors) {
+            return 0;
+        }
+    }
+    return empty_slots > 0;
+}
+
+/*
+ * load_snapshot(filename, csr) -- Maps an index file in as the packed
+ * graph. Returns 1 if it was loaded, 0 if the file is not an index file
+ * (or cannot be opened), and -1 if it is an index file that cannot be used.
+ */
+int load_snapshot(const char *filename, struct CsrGraph *csr) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+
+    struct SnapshotHeader header;
+    if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+            memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) {
+        close(fd);
+        return 0;
+    }
+
+    // Every section has to fit exactly, and the name table needs an empty
+    // slot for lookups of missing names to end
+    struct stat st;
+    size_t sizes[SNAPSHOT_SECTIONS];
+    size_t offsets[SNAPSHOT_SECTIONS];
+    size_t end = ALIGN8(sizeof(header));
+    int usable = header.version == SNAPSHOT_VERSION && header.byte_order == SNAPSHOT_BYTE_ORDER &&
+            header.num_actors >= 0 && header.num_movies >= 0 && header.num_links >= 0 &&
+            header.strings_size >= 0 && header.num_slots > header.num_actors &&
+            (header.num_slots & (header.num_slots - 1)) == 0 && fstat(fd, &st) == 0;
+    if (usable) {
+        section_sizes(&header, sizes);
+        for (int i = 0; i < SNAPSHOT_SECTIONS; i++) {
+            offsets[i] = end;
+            end += ALIGN8(sizes[i]);
+        }
+        usable = (size_t)st.st_size == end;
+    }
+    if (!usable) {
+        fprintf(stderr, "Error: %s is not an index file this bacon can read\n", filename);
+        close(fd);
+        return -1;
+    }
+
+    char *base = mmap(NULL, end, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Error: Cannot map index file %s\n", filename);
+        return -1;
+    }
+
+    csr->num_actors = header.num_actors;
+    csr->num_movies = header.num_movies;
+    csr->num_links = header.num_links;
+    csr->num_slots = header.num_slots;
+    csr->strings_size = header.strings_size;
+    csr->strings = base + offsets[0];
+    int **arrays[SNAPSHOT_SECTIONS - 1] = {
+        &csr->actor_names, &csr->movie_names, &csr->actor_offsets, &csr->actor_movies,
+        &csr->movie_offsets, &csr->movie_actors, &csr->actor_slots
+    };
+    for (int i = 1; i < SNAPSHOT_SECTIONS; i++) {
+        *arrays[i - 1] = (int*)(base + offsets[i]);
+    }
+    csr->mapping = base;
+    csr->mapping_size = end;
+    if (!valid_graph(csr)) {
+        fprintf(stderr, "Error: %s is a damaged index file\n", filename);
+        free_csr(csr);
+        return -1;
+    }
+    return 1;
+}
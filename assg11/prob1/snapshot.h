@@ -0,0 +1,36 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include "csr.h"
+
+// First bytes of an index file, and the version of its layout
+#define SNAPSHOT_MAGIC "BACONIDX"
+#define SNAPSHOT_VERSION 1
+
+// Written as a number, so a file from a machine of the other byte order is
+// recognized instead of misread
+#define SNAPSHOT_BYTE_ORDER 0x01020304
+
+/*
+ * SnapshotHeader starts an index file. The arrays of the packed graph
+ * follow it in the order of the fields of CsrGraph, each starting on a
+ * multiple of 8 bytes.
+ */
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    int32_t num_actors;
+    int32_t num_movies;
+    int32_t num_links;
+    int32_t num_slots;
+    int32_t strings_size;
+    int32_t unused;
+};
+
+// Function prototypes
+int write_snapshot(struct CsrGraph *csr, const char *filename);
+int load_snapshot(const char *filename, struct CsrGraph *csr);
+
+#endif
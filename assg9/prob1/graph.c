@@ -9,6 +9,29 @@
 #include <string.h>
 #include "graph.h"
 
+/* vector_push(PtrVector *vec, void *item) - appends item, doubling the capacity when the vector is full */
+void vector_push(PtrVector *vec, void *item) {
+    if (vec->count == vec->capacity) {
+        int new_capacity = vec->capacity == 0 ? 4 : vec->capacity * 2;
+        void **new_items = realloc(vec->items, sizeof(void*) * new_capacity);
+        if (new_items == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+        vec->items = new_items;
+        vec->capacity = new_capacity;
+    }
+    vec->items[vec->count++] = item;
+}
+
+/* vector_free(PtrVector *vec) - frees the array of a vector (not the items) and empties it */
+void vector_free(PtrVector *vec) {
+    free(vec->items);
+    vec->items = NULL;
+    vec->count = 0;
+    vec->capacity = 0;
+}
+
 /* find_node(NodeList *head, const char *name) - finds a node in the list by name, returns null if not found */
 Node* find_node(NodeList *head, const char *name) {
     NodeList *current = head;
@@ -33,10 +56,9 @@ Node* create_node(const char *name) {
         perror("strdup");
         exit(1);
     }
-    newNode->dependencies = NULL;
-    newNode->num_dependencies = 0;
-    newNode->commands = NULL;
-    newNode->num_commands = 0;
+    newNode->dependencies = (PtrVector){NULL, 0, 0};
+    newNode->commands = (PtrVector){NULL, 0, 0};
+    newNode->id = -1;
     newNode->visited = 0;
     newNode->is_target = 0;
     return newNode;
@@ -54,84 +76,107 @@ void add_node_to_list(NodeList **head, Node *newNode) {
     *head = newElem;
 }
 
-/* add_dependency(Node *target, Node *dependency) - adds a dependency to a node */
+/* add_dependency(Node *target, Node *dependency) - adds a dependency to a node in amortized O(1) */
 void add_dependency(Node *target, Node *dependency) {
-    // Allocate new, larger array
-    Node **new_deps = malloc(sizeof(Node*) * (target->num_dependencies + 1));
-    if (new_deps == NULL) {
-        perror("malloc");
-        exit(1);
-    }
-    // Copy old dependencies
-    for (int i = 0; i < target->num_dependencies; i++) {
-        new_deps[i] = target->dependencies[i];
-    }
-    // Add the new one
-    new_deps[target->num_dependencies] = dependency;
-    
-    // Free old array and update target
-    free(target->dependencies);
-    target->dependencies = new_deps;
-    target->num_dependencies++;
+    vector_push(&target->dependencies, dependency);
 }
 
-/* add_command(Node *target, const char *command) - adds a command to a target node */
+/* add_command(Node *target, const char *command) - adds a command to a target node in amortized O(1) */
 void add_command(Node *target, const char *command) {
-    // Allocate new, larger array for command pointers
-    char **new_cmds = malloc(sizeof(char*) * (target->num_commands + 1));
-    if (new_cmds == NULL) {
-        perror("malloc");
+    char *copy = strdup(command);
+    if (copy == NULL) {
+        perror("strdup");
         exit(1);
     }
-    // Copy old command pointers
-    for (int i = 0; i < target->num_commands; i++) {
-        new_cmds[i] = target->commands[i];
+    vector_push(&target->commands, copy);
+}
+
+/* freeze_graph(NodeList *head, Graph *graph) - packs the dependency lists of all nodes into one CSR edge
+ * array once parsing is done, and frees the per-node lists */
+void freeze_graph(NodeList *head, Graph *graph) {
+    int num_nodes = 0;
+    int num_edges = 0;
+    for (NodeList *current = head; current != NULL; current = current->next) {
+        num_nodes++;
+        num_edges += current->node->dependencies.count;
     }
-    // Add the new command
-    new_cmds[target->num_commands] = strdup(command);
-    if (new_cmds[target->num_commands] == NULL) {
-        perror("strdup");
+
+    graph->num_nodes = num_nodes;
+    graph->nodes = malloc(sizeof(Node*) * (num_nodes + 1));
+    graph->offsets = malloc(sizeof(int) * (num_nodes + 1));
+    graph->edges = malloc(sizeof(int) * (num_edges + 1));
+    if (graph->nodes == NULL || graph->offsets == NULL || graph->edges == NULL) {
+        perror("malloc");
         exit(1);
     }
 
-    // Free old array and update target
-    free(target->commands);
-    target->commands = new_cmds;
-    target->num_commands++;
+    // Number the nodes first, so edges can refer to them by id
+    int id = 0;
+    for (NodeList *current = head; current != NULL; current = current->next) {
+        current->node->id = id;
+        graph->nodes[id++] = current->node;
+    }
+
+    int edge = 0;
+    for (id = 0; id < num_nodes; id++) {
+        Node *node = graph->nodes[id];
+        graph->offsets[id] = edge;
+        for (int i = 0; i < node->dependencies.count; i++) {
+            graph->edges[edge++] = ((Node*)node->dependencies.items[i])->id;
+        }
+        vector_free(&node->dependencies);
+    }
+    graph->offsets[num_nodes] = edge;
 }
 
-/* post_order_traverse(Node *node) - Perform post-order traversal (DFS) */
-void post_order_traverse(Node *node) {
-    if (node == NULL || node->visited) {
+/* visit(Graph *graph, int id) - prints the subgraph below node id in post-order, skipping visited nodes */
+static void visit(Graph *graph, int id) {
+    Node *node = graph->nodes[id];
+    if (node->visited) {
         return;
     }
 
     // Mark as visited to handle cycles and avoid re-processing
     node->visited = 1;
 
-    // Recurse on dependencies
-    for (int i = 0; i < node->num_dependencies; i++) {
-        post_order_traverse(node->dependencies[i]);
+    // Recurse on dependencies, which sit next to each other in the edge array
+    for (int e = graph->offsets[id]; e < graph->offsets[id + 1]; e++) {
+        visit(graph, graph->edges[e]);
     }
 
     // Process the node itself
     printf("%s\n", node->name);
-    for (int i = 0; i < node->num_commands; i++) {
-        printf("  %s\n", node->commands[i]);
+    for (int i = 0; i < node->commands.count; i++) {
+        printf("  %s\n", (char*)node->commands.items[i]);
     }
 }
 
+/* post_order_traverse(Graph *graph, Node *node) - Perform post-order traversal (DFS) of a frozen graph */
+void post_order_traverse(Graph *graph, Node *node) {
+    if (node == NULL) {
+        return;
+    }
+    visit(graph, node->id);
+}
+
+/* free_frozen_graph(Graph *graph) - frees the CSR arrays of a frozen graph */
+void free_frozen_graph(Graph *graph) {
+    free(graph->nodes);
+    free(graph->offsets);
+    free(graph->edges);
+}
+
 /* free_graph(NodeList *head) - Free all allocated memory */
 void free_graph(NodeList *head) {
     NodeList *current = head;
     while (current != NULL) {
         Node *node = current->node;
         free(node->name);
-        free(node->dependencies);
-        for (int i = 0; i < node->num_commands; i++) {
-            free(node->commands[i]);
+        vector_free(&node->dependencies);
+        for (int i = 0; i < node->commands.count; i++) {
+            free(node->commands.items[i]);
         }
-        free(node->commands);
+        vector_free(&node->commands);
         free(node);
         
         NodeList *temp = current;
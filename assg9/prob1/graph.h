@@ -1,17 +1,34 @@
 #ifndef GRAPH_H
 #define GRAPH_H
 
+// Growable array of pointers. The capacity doubles each time it fills up,
+// so appending n items costs O(n) copying and O(log n) allocations in total.
+typedef struct PtrVector {
+    void **items;
+    int count;
+    int capacity;
+} PtrVector;
+
 // Node to represent a target in the dependency graph
 typedef struct Node {
     char *name;
-    struct Node **dependencies;
-    int num_dependencies;
-    char **commands;
-    int num_commands;
+    PtrVector dependencies; // Node pointers, moved into the Graph by freeze_graph
+    PtrVector commands; // Command strings
+    int id; // Index of the node in the Graph
     int visited; // Flag for post-order traversal
     int is_target; // Flag to check for duplicate targets
 } Node;
 
+// The finished graph in compressed sparse row form. The dependencies of
+// nodes[i] are the nodes whose ids are edges[offsets[i]] up to
+// edges[offsets[i + 1] - 1], so every edge list is one contiguous run.
+typedef struct Graph {
+    Node **nodes;
+    int num_nodes;
+    int *offsets;
+    int *edges;
+} Graph;
+
 // A list to keep track of all nodes created
 typedef struct NodeList {
     Node *node;
@@ -19,12 +36,16 @@ typedef struct NodeList {
 } NodeList;
 
 // Function prototypes
+void vector_push(PtrVector *vec, void *item);
+void vector_free(PtrVector *vec);
 Node* find_node(NodeList *head, const char *name);
 Node* create_node(const char *name);
 void add_node_to_list(NodeList **head, Node *newNode);
 void add_dependency(Node *target, Node *dependency);
 void add_command(Node *target, const char *command);
-void post_order_traverse(Node *target);
+void freeze_graph(NodeList *head, Graph *graph);
+void post_order_traverse(Graph *graph, Node *target);
+void free_frozen_graph(Graph *graph);
 void free_graph(NodeList *head);
 
 #endif
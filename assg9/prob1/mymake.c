@@ -124,10 +124,13 @@ int main(int argc, char *argv[]) {
         exit(1);
     }
 
-    // Perform traversal and print
-    post_order_traverse(final_target);
+    // Pack the edges into one array, then traverse and print
+    Graph graph;
+    freeze_graph(all_nodes, &graph);
+    post_order_traverse(&graph, final_target);
 
     // Cleanup
+    free_frozen_graph(&graph);
     free_graph(all_nodes);
 
     return 0;